@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+// Compares a run summary written by RunSummary against a stored baseline. Phase times (time.*) regress only
+// when they grow beyond the tolerance, counts (count.*) and final values (value.*) when they differ by more
+// than theirs in either direction. Keys of the baseline missing from the current summary are regressions,
+// and so are new counts, since the drivers write every count from the start; other new keys are listed but
+// accepted. Only the kinds of keys present in the baseline are compared, so that the machine-independent
+// counts and values and the machine-specific times can be kept in separate baselines. Exits with 1 on any
+// regression.
+//
+//     hlCompareSummary baseline current [--time-tol 0.15] [--count-tol 0] [--value-tol 1e-6]
+
+namespace
+{
+std::map<std::string, double> readSummary(const std::string& fileName)
+{
+    std::ifstream in(fileName);
+    if(!in) {
+        std::cerr << "hlCompareSummary: cannot open " << fileName << std::endl;
+        exit(2);
+    }
+
+    std::map<std::string, double> entries;
+    std::string line;
+    while(std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string key;
+        double v;
+        if(words >> key >> v)
+            entries[key] = v;
+    }
+    return entries;
+}
+
+// Kind of a key: time, count or value
+std::string kind(const std::string& key)
+{
+    return key.substr(0, key.find('.'));
+}
+
+// Counts are often 0 in the baseline; any change from 0 is infinite
+double relativeChange(double baseline, double current)
+{
+    if(baseline == 0.0)
+        return current == 0.0 ? 0.0 : std::copysign(HUGE_VAL, current);
+    return (current - baseline) / std::abs(baseline);
+}
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3) {
+        std::cerr << "usage: hlCompareSummary baseline current [--time-tol 0.15] [--count-tol 0] [--value-tol 1e-6]" << std::endl;
+        return 2;
+    }
+
+    double timeTol{0.15}, countTol{0.0}, valueTol{1.E-6};
+    for(int a = 3; a < argc; a++) {
+        const std::string option = argv[a];
+        if(a + 1 == argc) {
+            std::cerr << "hlCompareSummary: missing value for " << option << std::endl;
+            return 2;
+        }
+        const double v = std::atof(argv[++a]);
+        if(option == "--time-tol")
+            timeTol = v;
+        else if(option == "--count-tol")
+            countTol = v;
+        else if(option == "--value-tol")
+            valueTol = v;
+        else {
+            std::cerr << "hlCompareSummary: unknown option " << option << std::endl;
+            return 2;
+        }
+    }
+
+    const std::map<std::string, double> baseline = readSummary(argv[1]);
+    const std::map<std::string, double> current = readSummary(argv[2]);
+
+    std::set<std::string> kinds;
+    for(const auto& [key, b] : baseline)
+        kinds.insert(kind(key));
+
+    int regressions{};
+    std::cout << std::setprecision(6);
+    for(const auto& [key, b] : baseline) {
+        const auto c = current.find(key);
+        if(c == current.end()) {
+            std::cout << "FAIL  " << key << " missing" << std::endl;
+            regressions++;
+            continue;
+        }
+
+        const double change = relativeChange(b, c->second);
+        bool failed;
+        if(key.rfind("time.", 0) == 0)
+            failed = change > timeTol;
+        else if(key.rfind("count.", 0) == 0)
+            failed = std::abs(change) > countTol;
+        else
+            failed = std::abs(change) > valueTol;
+
+        std::cout << (failed ? "FAIL  " : "ok    ") << std::setw(32) << std::left << key << std::right
+                  << std::setw(14) << b << std::setw(14) << c->second << std::setw(10) << std::fixed
+                  << std::setprecision(1) << 100.0 * change << " %" << std::defaultfloat << std::setprecision(6) << std::endl;
+        if(failed)
+            regressions++;
+    }
+    for(const auto& [key, c] : current)
+        if(kinds.count(kind(key)) and baseline.find(key) == baseline.end()) {
+            if(key.rfind("count.", 0) == 0) {
+                std::cout << "FAIL  " << key << " " << c << " not in the baseline" << std::endl;
+                regressions++;
+            }
+            else
+                std::cout << "new   " << key << " " << c << std::endl;
+        }
+
+    std::cout << regressions << " regression(s)" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
@@ -1,4 +1,4 @@
-#include <random>
+#include <algorithm>
 
 #include <hl_LinearSolver_Iterative_Belos.h>
 #include <hl_NonlinearSolver_NewtonRaphson.h>
@@ -12,6 +12,14 @@
 #include "hl_Parser.h"
 
 #include "Physics.h"
+#include "Ensemble.h"
+#include "GhostExchange.h"
+#include "MemoryReport.h"
+#include "MeshCache.h"
+#include "PatternAnalysis.h"
+#include "Random.h"
+#include "RunSummary.h"
+#include "SampledConsistencyCheck.h"
 
 int main(int argc, char** argv) {
     using std::cout, std::cerr;
@@ -20,19 +28,28 @@ int main(int argc, char** argv) {
     hiperlife::Init(argc, argv);
 
     SmartPtr<ParamStructure> paramStr = ReadParamsFromCommandLine<Params>();
+    SetAssemblyOptions(paramStr);
 
-    SaveParamsToConfigFile(paramStr, paramStr->getStringParameter(Params::prefix) + "_config.txt");
+    MemoryReport memory(MPI_COMM_WORLD);
+
+    // Generated polygons are cached by size and number of ranks, so that sweeps of short runs skip the
+    // meshing step and the rebalance
+    int numRanks{};
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+    const double h = paramStr->getRealParameter(Params::meshsize);
+    const std::string meshCacheFile = MeshCacheFile(paramStr->getStringParameter(Params::meshcache), h, numRanks);
+    const bool fromCache = paramStr->getStringParameter(Params::filemesh) == "" and MeshCacheExists(meshCacheFile, MPI_COMM_WORLD);
+    const bool generateMesh = paramStr->getStringParameter(Params::filemesh) == "" and !fromCache;
 
     SmartPtr<MeshCreator> meshCreator;
-    if(paramStr->getStringParameter(Params::filemesh) == "") {
+    if(generateMesh) {
         SmartPtr<UnstructVtkMeshGenerator> meshGen = Create<UnstructVtkMeshGenerator>();
         meshGen->setMesh(hiperlife::ElemType::Triang, BasisFuncType::Linear, 1);
-        const double h = 0.002;
         meshGen->genPolygon([h](double x[3]){ return h;});
         meshCreator = meshGen;
     }
     else {
-        std::string meshFile(paramStr->getStringParameter(Params::filemesh));
+        std::string meshFile(paramStr->getStringParameter(Params::filemesh) == "" ? meshCacheFile : paramStr->getStringParameter(Params::filemesh));
         SmartPtr<MeshLoader> meshLoader = Create<MeshLoader>();
         meshLoader->setMesh(hiperlife::ElemType::Triang, BasisFuncType::Linear, 1);
         meshLoader->loadVtk(meshFile, MeshType::Parallel);
@@ -42,26 +59,44 @@ int main(int argc, char** argv) {
 
     SmartPtr<DistributedMesh> mesh = Create<DistributedMesh>();
     mesh->setMesh(meshCreator);
-    mesh->setBalanceMesh(true);
+    mesh->setBalanceMesh(!fromCache);
     mesh->Update();
+    memory.mark("mesh");
+
+    if(generateMesh and !meshCacheFile.empty())
+        WriteMeshCache(mesh, meshCacheFile, MPI_COMM_WORLD);
 
     SmartPtr<DOFsHandler> fieldMorphogens = Create<DOFsHandler>(mesh);
     fieldMorphogens->setNameTag("morphogens");
-    fieldMorphogens->setDOFs({"c", "h", "m"});
+    fieldMorphogens->setDOFs({"c", "h"});
     fieldMorphogens->setNodeAuxF({"vx", "vy", "ux", "uy", "uxN", "uyN"});
     fieldMorphogens->Update();
+    memory.mark("fieldMorphogens");
+    memory.addDOFsHandler("fieldMorphogens", fieldMorphogens, 6);
+
+    SmartPtr<DOFsHandler> fieldTransport = Create<DOFsHandler>(mesh);
+    fieldTransport->setNameTag("transport");
+    fieldTransport->setDOFs({"m"});
+    fieldTransport->setNodeAuxF({"vx", "vy", "ux", "uy", "uxN", "uyN"});
+    fieldTransport->Update();
+    memory.mark("fieldTransport");
+    memory.addDOFsHandler("fieldTransport", fieldTransport, 6);
 
     SmartPtr<DOFsHandler> fieldVelocity = Create<DOFsHandler>(mesh);
     fieldVelocity->setNameTag("velocity");
     fieldVelocity->setDOFs({"vx", "vy"});
     fieldVelocity->setNodeAuxF({"c", "h", "m"});
     fieldVelocity->Update();
+    memory.mark("fieldVelocity");
+    memory.addDOFsHandler("fieldVelocity", fieldVelocity, 3);
 
     SmartPtr<DOFsHandler> fieldDisplacement = Create<DOFsHandler>(mesh);
     fieldDisplacement->setNameTag("displacement");
     fieldDisplacement->setDOFs({"ux", "uy"});
     fieldDisplacement->setNodeAuxF({"x0", "y0", "vx", "vy", "errUx", "errUy"});
     fieldDisplacement->Update();
+    memory.mark("fieldDisplacement");
+    memory.addDOFsHandler("fieldDisplacement", fieldDisplacement, 2);
     fieldDisplacement->setInitialCondition(0, 0.0);
     fieldDisplacement->setInitialCondition(1, 0.0);
     fieldDisplacement->UpdateGhosts();
@@ -73,9 +108,16 @@ int main(int argc, char** argv) {
     fieldMorphogens->nodeAuxF->mirrorField(4, 0, fieldDisplacement->nodeDOFs0);
     fieldMorphogens->nodeAuxF->mirrorField(5, 1, fieldDisplacement->nodeDOFs0);
 
+    fieldTransport->nodeAuxF->mirrorField(0, 0, fieldVelocity->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(1, 1, fieldVelocity->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(2, 0, fieldDisplacement->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(3, 1, fieldDisplacement->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(4, 0, fieldDisplacement->nodeDOFs0);
+    fieldTransport->nodeAuxF->mirrorField(5, 1, fieldDisplacement->nodeDOFs0);
+
     fieldVelocity->nodeAuxF->mirrorField(0, 0, fieldMorphogens->nodeDOFs);
     fieldVelocity->nodeAuxF->mirrorField(1, 1, fieldMorphogens->nodeDOFs);
-    fieldVelocity->nodeAuxF->mirrorField(2, 2, fieldMorphogens->nodeDOFs);
+    fieldVelocity->nodeAuxF->mirrorField(2, 0, fieldTransport->nodeDOFs);
 
     fieldDisplacement->nodeAuxF->setValue(0, 0, mesh->_nodeData);
     fieldDisplacement->nodeAuxF->setValue(1, 1, mesh->_nodeData);
@@ -87,33 +129,58 @@ int main(int argc, char** argv) {
     problem->setParameterStructure(paramStr);
     problem->setDOFsHandlers({fieldMorphogens});
     problem->setIntegration("IntegMorphogens", {"morphogens"});
-    problem->setCubatureGauss("IntegMorphogens", 3);
+    problem->setCubatureGauss("IntegMorphogens", static_cast<int>(paramStr->getRealParameter(Params::quadorder)));
     if (paramStr->getStringParameter(Params::consistency) == "none") {
         problem->setElementFillings("IntegMorphogens", ConvectionDiffusionALE);
+    }else if (paramStr->getStringParameter(Params::consistency) == "full") {
+        problem->setElementFillings("IntegMorphogens", ConsistencyCheck<ConvectionDiffusionALE>);
+        problem->setConsistencyCheckDelta(1.E-4);
+        problem->setConsistencyCheckTolerance(1.E-4);
+        problem->setConsistencyCheckType(ConsistencyCheckType::Both);
     }    else if (paramStr->getStringParameter(Params::consistency) == "hessian") {
         problem->setElementFillings("IntegMorphogens", ConsistencyCheck<ConvectionDiffusionALE>);
         problem->setConsistencyCheckDelta(1.E-4);
         problem->setConsistencyCheckTolerance(1.E-4);
         problem->setConsistencyCheckType(ConsistencyCheckType::Hessian);
+    }    else if (paramStr->getStringParameter(Params::consistency) == "sampled") {
+        problem->setElementFillings("IntegMorphogens", SampledConsistencyCheck<ConvectionDiffusionALE>);
+        SampledConsistency::instance().configure("morphogens", paramStr->getRealParameter(Params::consistencyrate),
+                                                 static_cast<int>(paramStr->getRealParameter(Params::consistencyevery)),
+                                                 paramStr->getRealParameter(Params::consistencydelta),
+                                                 paramStr->getRealParameter(Params::consistencytol),
+                                                 SeedFromParameter(paramStr->getRealParameter(Params::seed)));
+    }
+    if(paramStr->getStringParameter(Params::quadrature) == "split") {
+        // Diffusion is constant on each linear triangle: one point instead of the reaction rule
+        problem->setIntegration("IntegDiffusion", {"morphogens"});
+        problem->setCubatureGauss("IntegDiffusion", 1);
+        problem->setElementFillings("IntegDiffusion", MorphogenDiffusion);
     }
-    problem->setGlobalIntegrals({"area","mass"});
     problem->Update();
-    problem->FillLinearSystem();
-    problem->globalIntegral("mass"); // devuelve mass en step 0
+    memory.mark("problem (matrix graph)");
+
+    // m is linear and does not feed back into c and h, so it is solved once per step outside Newton
+    SmartPtr<HiPerProblem> problemTransport = Create<HiPerProblem>();
+    problemTransport->setParameterStructure(paramStr);
+    problemTransport->setDOFsHandlers({fieldTransport});
+    problemTransport->setIntegration("IntegTransport", {"transport"});
+    problemTransport->setCubatureGauss("IntegTransport", 3);
+    problemTransport->setElementFillings("IntegTransport", TransportALE);
+    problemTransport->Update();
+    memory.mark("problemTransport (matrix graph)");
+
+    // Area and mass have their own pass over the solved m: the transport fill runs before the solve
+    SmartPtr<HiPerProblem> problemIntegrals = Create<HiPerProblem>();
+    problemIntegrals->setParameterStructure(paramStr);
+    problemIntegrals->setDOFsHandlers({fieldTransport});
+    problemIntegrals->setIntegration("IntegTransport", {"transport"});
+    problemIntegrals->setCubatureGauss("IntegTransport", 3);
+    problemIntegrals->setElementFillings("IntegTransport", TransportIntegrals);
+    problemIntegrals->setGlobalIntegrals({"area","mass"});
+    problemIntegrals->Update();
+    memory.mark("problemIntegrals (matrix graph)");
     if(problem->myRank()==0){cout << "MUMPS analysis type: " << paramStr->getStringParameter(Params::mumpsanalysis) << endl;}
-
-    std::random_device rd;  // seed the random number generator
-    std::mt19937 gen(rd()); // use the Mersenne Twister 19937 generator
-    std::uniform_real_distribution<double> dis(-0.01, 0.01); // create a uniform distribution of doubles between 0 and 1
-    fieldMorphogens->setInitialCondition("c", [&gen, &dis](double x, double y){
-        return 1.0 + dis(gen);
-    });
-    fieldMorphogens->setInitialCondition("h", [&dis, &gen](double x, double y) {
-        return 1.0 + dis(gen);
-    });
-    fieldMorphogens->setInitialCondition("m", 1.0);
-
-    fieldMorphogens->printFileVtk("fieldMorphogens0", true);
+    if(problem->myRank()==0){cout << "MUMPS factorization: " << paramStr->getStringParameter(Params::factorization) << endl;}
 
     SmartPtr<MUMPSDirectLinearSolver> linSolReactionDiff = Create<MUMPSDirectLinearSolver>();
     linSolReactionDiff->setHiPerProblem(problem);
@@ -123,7 +190,9 @@ int main(int argc, char** argv) {
         linSolReactionDiff->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Sequential);
     }else
         linSolReactionDiff->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
+    SetFactorization(linSolReactionDiff, paramStr);
     linSolReactionDiff->Update();
+    memory.mark("linSolReactionDiff analysis");
 
     SmartPtr<NewtonRaphsonNonlinearSolver> nonLinSolReactionDiff = Create<NewtonRaphsonNonlinearSolver>();
     nonLinSolReactionDiff->setLinearSolver(linSolReactionDiff);
@@ -136,6 +205,19 @@ int main(int argc, char** argv) {
     nonLinSolReactionDiff->setPrintSummary(true);
     nonLinSolReactionDiff->Update();
 
+    SmartPtr<MUMPSDirectLinearSolver> linSolTransport = Create<MUMPSDirectLinearSolver>();
+    linSolTransport->setHiPerProblem(problemTransport);
+    linSolTransport->setVerbosity(MUMPSDirectLinearSolver::Verbosity::None);
+    linSolTransport->setDefaultParameters();
+    if(paramStr->getStringParameter(Params::mumpsanalysis) == "sequential") {
+        linSolTransport->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Sequential);
+    }else{
+        linSolTransport->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
+    }
+    SetFactorization(linSolTransport, paramStr);
+    linSolTransport->Update();
+    memory.mark("linSolTransport analysis");
+
     SmartPtr<HiPerProblem> problemFlow = Create<HiPerProblem>();
     problemFlow->setParameterStructure(paramStr);
     problemFlow->setDOFsHandlers({fieldVelocity});
@@ -143,6 +225,7 @@ int main(int argc, char** argv) {
     problemFlow->setCubatureGauss("IntegFlow", 3);
     problemFlow->setElementFillings("IntegFlow", TensionFlow);
     problemFlow->Update();
+    memory.mark("problemFlow (matrix graph)");
 
     SmartPtr<MUMPSDirectLinearSolver> linSolFlow = Create<MUMPSDirectLinearSolver>();
     linSolFlow->setHiPerProblem(problemFlow);
@@ -154,12 +237,9 @@ int main(int argc, char** argv) {
         linSolFlow->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
 
     }
+    SetFactorization(linSolFlow, paramStr);
     linSolFlow->Update();
-
-    problemFlow->UpdateGhosts();
-    linSolFlow->solve();
-    linSolFlow->UpdateSolution();
-    fieldVelocity->printFileVtk(paramStr->getStringParameter(Params::prefix) + "_velocity_0", true);
+    memory.mark("linSolFlow analysis");
 
 
     SmartPtr<HiPerProblem> problemDispl = Create<HiPerProblem>();
@@ -172,6 +252,7 @@ int main(int argc, char** argv) {
     problemDispl->setCubatureBorderGauss("IntegALEBoundary", 3);
     problemDispl->setElementFillings("IntegALEBoundary", ALEBoundary);
     problemDispl->Update();
+    memory.mark("problemDispl (matrix graph)");
 
     SmartPtr<MUMPSDirectLinearSolver> linSolDispl = Create<MUMPSDirectLinearSolver>();
     linSolDispl->setHiPerProblem(problemDispl);
@@ -182,66 +263,224 @@ int main(int argc, char** argv) {
     }else{
         linSolDispl->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
     }
+    SetFactorization(linSolDispl, paramStr);
     linSolDispl->Update();
+    memory.mark("linSolDispl analysis");
 
     // DeformMesh(linSolDispl, fieldDisplacement);
 
-    fieldDisplacement->printFileVtk(paramStr->getStringParameter(Params::prefix) + "displacement_0", true);
-
-    double& dt = paramStr->getRealParameter(Params::dt);
-    for(int i = 1; i < 1000; i++) {
-        if(problem->myRank() == 0)
-            std::cout << "step: " << i << " : dt: " << dt << endl;
-
-        fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
-        nonLinSolReactionDiff->solve();
-        // pintar area y masa. 
-        double mass = problem->globalIntegral("mass");
-        if (problem->myRank() == 0) {
-            std::ofstream out("mass_history.txt", std::ios::app);
-            out << i << "\t" << mass << "\n";
-        }
-        if(nonLinSolReactionDiff->converged()){
-            if(nonLinSolReactionDiff->numberOfIterations() <= 4)
-                dt *= 1.1;
-            else if(nonLinSolReactionDiff->numberOfIterations() > 7)
-                dt *= 0.9;
-        }
-        else {
-            fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
-            dt *= 0.8;
-            i--;
-
-            if(dt < 1e-10)
-                break;
-
-            continue;
-        }
+    GhostExchange ghosts(mesh);
+
+    // Mesh, DOFsHandlers, problems and MUMPS analyses are shared by all the members of an ensemble
+    EnsembleParameters ensembleParams(paramStr);
+    for(const EnsembleMember& member : ReadEnsemble(paramStr)) {
+        ensembleParams.apply(member);
+        const std::string prefix = member.prefix;
+        SaveParamsToConfigFile(paramStr, prefix + "_config.txt");
+
+        // A single run keeps the file names it had before ensembles, which only members need to tell apart
+        const bool single = paramStr->getStringParameter(Params::ensemble).empty();
+        const std::string morphogens0File = single ? "fieldMorphogens0" : prefix + "_morphogens_0";
+        const std::string displacement0File = single ? prefix + "displacement_0" : prefix + "_displacement_0";
+        const std::string velocityFile = single ? "fieldVelocity" : prefix + "_velocity_";
+        const std::string massHistoryFile = single ? "mass_history.txt" : prefix + "_mass_history.txt";
+
+        // Every member starts from the reference configuration
+        ResetMesh(fieldDisplacement);
+
+        // Perturbations keyed on the node position: identical for any partition and visiting order
+        const uint32_t seed = SeedFromParameter(paramStr->getRealParameter(Params::seed));
+        fieldMorphogens->setInitialCondition("c", [seed](double x, double y){
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 0) - 1.0);
+        });
+        fieldMorphogens->setInitialCondition("h", [seed](double x, double y) {
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 1) - 1.0);
+        });
+        fieldTransport->setInitialCondition("m", 1.0);
+
+        PatternAnalysis analysis(fieldMorphogens, 0, PatternAnalysis::Geometry::Radial,
+                                 static_cast<int>(paramStr->getRealParameter(Params::analysisbins)), 0.0, prefix + "_pattern.txt");
+        const int analysisEvery = static_cast<int>(paramStr->getRealParameter(Params::analysisevery));
+        const int outputEvery = static_cast<int>(paramStr->getRealParameter(Params::outputevery));
+
+        fieldMorphogens->printFileVtk(morphogens0File, true);
+        fieldTransport->printFileVtk(prefix + "_transport_0", true);
+
+        problemFlow->UpdateGhosts();
+        SolveWithFallback(linSolFlow);
+        memory.markOnce("linSolFlow factorization");
+        memory.addFactorization("linSolFlow", linSolFlow);
+        linSolFlow->UpdateSolution();
+        fieldVelocity->printFileVtk(prefix + "_velocity_0", true);
 
-        std::string fileCI = paramStr->getStringParameter(Params::prefix) + "_morphogens_" + to_string(i);
-        fieldMorphogens->printFileVtk(fileCI, true);
+        fieldDisplacement->printFileVtk(displacement0File, true);
 
-        linSolFlow->solve();
-        linSolFlow->UpdateSolution();
+        double& dt = paramStr->getRealParameter(Params::dt);
+        double time{};
 
-        if(problem->myRank() == 0)
-            cout << "I solved for velocities!!!!" << endl;
+        // Step 0 values, kept if no step is accepted
+        problemIntegrals->FillLinearSystem();
+        double area = problemIntegrals->globalIntegral("area");
+        double mass = problemIntegrals->globalIntegral("mass");
 
-        std::string fileVI = "fieldVelocity" + to_string(i);
-        fieldVelocity->printFileVtk(fileVI, true);
+        RunSummary summary(MPI_COMM_WORLD);
+        // Every count is written even when it stays 0, so that a baseline without rejections still catches them
+        summary.count("newton_iterations", 0);
+        summary.count("rejected_steps", 0);
+        summary.count("steps", 0);
+        const int lastStep = paramStr->getRealParameter(Params::nsteps) > 0.0 ? static_cast<int>(paramStr->getRealParameter(Params::nsteps)) : 999;
+        for(int i = 1; i <= lastStep; i++) {
+            if(problem->myRank() == 0)
+                std::cout << "step: " << i << " : dt: " << dt << endl;
+
+            const double stepDt = dt;
+            const bool writeFields = outputEvery > 0 and i % outputEvery == 0;
+            SampledConsistency::instance().beginStep(i);
+            fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
+            summary.begin("newton");
+            nonLinSolReactionDiff->solve();
+            CheckFactorization(linSolReactionDiff);
+            summary.end("newton");
+            summary.count("newton_iterations", nonLinSolReactionDiff->numberOfIterations());
+            memory.markOnce("linSolReactionDiff factorization");
+            memory.addFactorization("linSolReactionDiff", linSolReactionDiff);
+            if(nonLinSolReactionDiff->converged()){
+                if(nonLinSolReactionDiff->numberOfIterations() <= 4)
+                    dt *= 1.1;
+                else if(nonLinSolReactionDiff->numberOfIterations() > 7)
+                    dt *= 0.9;
+            }
+            else {
+                summary.count("rejected_steps");
+                fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
+                dt *= 0.8;
+                i--;
+
+                if(dt < 1e-10)
+                    break;
+
+                continue;
+            }
+
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileCI = prefix + "_morphogens_" + to_string(i);
+                fieldMorphogens->printFileVtk(fileCI, true);
+                memory.markOnce("output buffers");
+                summary.end("output");
+            }
+
+            summary.begin("transport");
+            fieldTransport->nodeDOFs0->setValue(fieldTransport->nodeDOFs);
+            problemTransport->UpdateGhosts();
+            SolveWithFallback(linSolTransport);
+            memory.markOnce("linSolTransport factorization");
+            memory.addFactorization("linSolTransport", linSolTransport);
+            summary.end("transport");
+
+            // A failed m solve rejects the whole step, as a failed Newton solve does
+            if(!linSolTransport->converged()) {
+                if(problem->myRank() == 0)
+                    std::cout << "Transport solve has not converged, rejecting the step." << endl;
+                summary.count("rejected_steps");
+                fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
+                dt = 0.8 * stepDt;
+                i--;
+
+                if(dt < 1e-10)
+                    break;
+
+                continue;
+            }
+            linSolTransport->UpdateSolution();
+            ghosts.markDirty(fieldTransport->nodeDOFs);
+
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileTI = prefix + "_transport_" + to_string(i);
+                fieldTransport->printFileVtk(fileTI, true);
+                summary.end("output");
+            }
+
+            summary.begin("flow");
+            fieldVelocity->nodeDOFs0->setValue(fieldVelocity->nodeDOFs);
+            SolveWithFallback(linSolFlow);
+            linSolFlow->UpdateSolution();
+            summary.end("flow");
+            time += stepDt;
 
-        DeformMesh(linSolDispl, fieldDisplacement);
-        std::string fileDI = paramStr->getStringParameter(Params::prefix) + "_displacement_" + to_string(i);
-        fieldDisplacement->printFileVtk(fileDI, true);
+            if(problem->myRank() == 0)
+                cout << "I solved for velocities!!!!" << endl;
+
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileVI = velocityFile + to_string(i);
+                fieldVelocity->printFileVtk(fileVI, true);
+                summary.end("output");
+            }
+
+            summary.begin("mesh motion");
+            DeformMesh(linSolDispl, fieldDisplacement, ghosts);
+            memory.markOnce("linSolDispl factorization");
+            memory.addFactorization("linSolDispl", linSolDispl);
+            ghosts.flush();
+            summary.end("mesh motion");
+            summary.count("steps");
+
+            // pintar area y masa: m of this step on the mesh it has been moved to
+            problemIntegrals->FillLinearSystem();
+            area = problemIntegrals->globalIntegral("area");
+            mass = problemIntegrals->globalIntegral("mass");
+            if (problem->myRank() == 0) {
+                std::ofstream out(massHistoryFile, std::ios::app);
+                out << i << "\t" << mass << "\n";
+            }
+
+            // The CFL reduction completes while the displacement is written and the rates are reduced
+            CFLReduction cfl;
+            StartCFL(fieldVelocity, cfl);
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileDI = prefix + "_displacement_" + to_string(i);
+                fieldDisplacement->printFileVtk(fileDI, true);
+                summary.end("output");
+            }
+            if(analysisEvery > 0 and i % analysisEvery == 0) {
+                summary.begin("analysis");
+                analysis.analyze(i, time);
+                summary.end("analysis");
+            }
+
+            const double rateC = FieldChange(fieldMorphogens, 0) / stepDt;
+            const double rateH = FieldChange(fieldMorphogens, 1) / stepDt;
+            const double rateV = std::max(FieldChange(fieldVelocity, 0), FieldChange(fieldVelocity, 1)) / stepDt;
+            const double cflDt = FinishCFL(cfl);
 
-        const double cflDt = CheckCFL(fieldVelocity);
-        if(cflDt < dt) {
-            const double newDt = 0.9*cflDt;
             if(problem->myRank() == 0)
-                std::cout << "Warning!!! cfl condition is not satisfied, decreasing time step. Current dt: " << i << " : dt: " << paramStr->getRealParameter(Params::dt) << " -> new dt: " << newDt << endl;
-            paramStr->setRealParameter(Params::dt, newDt);
+                std::cout << "rates of change: c: " << rateC << " h: " << rateH << " v: " << rateV << endl;
+
+            // No steady-state detection here: the mesh follows the flow, and a steady solve on a frozen mesh would
+            // drop the mesh velocity while keeping the flow advection, which is not a consistent problem
+            if(cflDt < dt) {
+                const double newDt = 0.9*cflDt;
+                if(problem->myRank() == 0)
+                    std::cout << "Warning!!! cfl condition is not satisfied, decreasing time step. Current dt: " << i << " : dt: " << paramStr->getRealParameter(Params::dt) << " -> new dt: " << newDt << endl;
+                paramStr->setRealParameter(Params::dt, newDt);
+            }
         }
+
+        summary.value("time", time);
+        summary.value("area", area);
+        summary.value("mass", mass);
+        summary.value("mean_c", FieldMean(fieldMorphogens, 0));
+        summary.value("mean_h", FieldMean(fieldMorphogens, 1));
+        summary.write(prefix + "_summary.txt");
     }
 
+    ghosts.report(MPI_COMM_WORLD);
+    if(paramStr->getStringParameter(Params::consistency) == "sampled")
+        SampledConsistency::instance().report(MPI_COMM_WORLD, paramStr->getStringParameter(Params::prefix) + "_consistency.txt");
+    memory.report(paramStr->getStringParameter(Params::prefix) + "_memory.txt");
+
     hiperlife::Finalize();
 }
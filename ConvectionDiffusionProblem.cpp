@@ -1,7 +1,8 @@
+#include <algorithm>
+
 #include <hl_LinearSolver_Iterative_Belos.h>
 #include <hl_NonlinearSolver_NewtonRaphson.h>
 #include <hl_LinearSolver_Direct_MUMPS.h>
-#include <random>
 #include "hl_DistributedClass.h"
 #include "hl_HiPerProblem.h"
 #include "hl_StructMeshGenerator.h"
@@ -10,6 +11,13 @@
 #include "hl_Parser.h"
 
 #include "Physics.h"
+#include "Ensemble.h"
+#include "GhostExchange.h"
+#include "MemoryReport.h"
+#include "PatternAnalysis.h"
+#include "Random.h"
+#include "RunSummary.h"
+#include "SampledConsistencyCheck.h"
 
 int main(int argc, char** argv) {
     using std::cout, std::cerr;
@@ -19,31 +27,45 @@ int main(int argc, char** argv) {
     hiperlife::Init(argc, argv);
 
     SmartPtr<ParamStructure> paramStr = ReadParamsFromCommandLine<Params>();
+    SetAssemblyOptions(paramStr);
 
-    SaveParamsToConfigFile(paramStr, paramStr->getStringParameter(Params::prefix) + "_config.txt");
+    MemoryReport memory(MPI_COMM_WORLD);
 
     SmartPtr<StructMeshGenerator> meshGen = Create<StructMeshGenerator>();
     meshGen->setMesh(ElemType::Triang, BasisFuncType::Lagrangian, 1);
     meshGen->setPeriodicBoundaryCondition({Axis::Xaxis, Axis::Yaxis});
     // meshGen->genSquare(50, 2.0);
-    meshGen->genRectangle(1000, 1, 2.0, 2.0);
+    const double domainLength = 2.0;
+    const int numElem = paramStr->getRealParameter(Params::nelem) > 0.0 ? static_cast<int>(paramStr->getRealParameter(Params::nelem)) : 1000;
+    meshGen->genRectangle(numElem, 1, domainLength, domainLength);
 
     SmartPtr<DistributedMesh> mesh = Create<DistributedMesh>();
     mesh->setMesh(meshGen);
     mesh->setBalanceMesh(true);
     mesh->Update();
+    memory.mark("mesh");
 
     SmartPtr<DOFsHandler> fieldMorphogens= Create<DOFsHandler>(mesh);
     fieldMorphogens->setNameTag("morphogens");
-    fieldMorphogens->setDOFs({"c", "h", "m"});
+    fieldMorphogens->setDOFs({"c", "h"});
     fieldMorphogens->setNodeAuxF({"vx", "vy"});
     fieldMorphogens->Update();
+    memory.mark("fieldMorphogens");
+    memory.addDOFsHandler("fieldMorphogens", fieldMorphogens, 2);
+
+    SmartPtr<DOFsHandler> fieldTransport = Create<DOFsHandler>(mesh);
+    fieldTransport->setNameTag("transport");
+    fieldTransport->setDOFs({"m"});
+    fieldTransport->setNodeAuxF({"vx", "vy"});
+    fieldTransport->Update();
+    memory.mark("fieldTransport");
+    memory.addDOFsHandler("fieldTransport", fieldTransport, 2);
 
     SmartPtr<HiPerProblem> problem = Create<HiPerProblem>();
     problem->setParameterStructure(paramStr);
     problem->setDOFsHandlers({fieldMorphogens});
     problem->setIntegration("IntegMorphogens", {"morphogens"});
-    problem->setCubatureGauss("IntegMorphogens", 3);
+    problem->setCubatureGauss("IntegMorphogens", static_cast<int>(paramStr->getRealParameter(Params::quadorder)));
     if (paramStr->getStringParameter(Params::consistency) == "none") {
         problem->setElementFillings("IntegMorphogens", ConvectionDiffusion);
     }else if (paramStr->getStringParameter(Params::consistency) == "full") {
@@ -51,28 +73,30 @@ int main(int argc, char** argv) {
         problem->setConsistencyCheckDelta(1.E-4);
         problem->setConsistencyCheckTolerance(1.E-4);
         problem->setConsistencyCheckType(ConsistencyCheckType::Both);
-    }    else if (paramStr->getStringParameter(Params::consistency) == "jacobian") {
+    }    else if (paramStr->getStringParameter(Params::consistency) == "hessian") {
         problem->setElementFillings("IntegMorphogens", ConsistencyCheck<ConvectionDiffusion>);
         problem->setConsistencyCheckDelta(1.E-4);
         problem->setConsistencyCheckTolerance(1.E-4);
         problem->setConsistencyCheckType(ConsistencyCheckType::Hessian);
+    }    else if (paramStr->getStringParameter(Params::consistency) == "sampled") {
+        problem->setElementFillings("IntegMorphogens", SampledConsistencyCheck<ConvectionDiffusion>);
+        SampledConsistency::instance().configure("morphogens", paramStr->getRealParameter(Params::consistencyrate),
+                                                 static_cast<int>(paramStr->getRealParameter(Params::consistencyevery)),
+                                                 paramStr->getRealParameter(Params::consistencydelta),
+                                                 paramStr->getRealParameter(Params::consistencytol),
+                                                 SeedFromParameter(paramStr->getRealParameter(Params::seed)));
+    }
+    if(paramStr->getStringParameter(Params::quadrature) == "split") {
+        // Diffusion is constant on each linear triangle: one point instead of the reaction rule
+        problem->setIntegration("IntegDiffusion", {"morphogens"});
+        problem->setCubatureGauss("IntegDiffusion", 1);
+        problem->setElementFillings("IntegDiffusion", MorphogenDiffusion);
     }
         problem->Update();
+        memory.mark("problem (matrix graph)");
 
     if(problem->myRank()==0){cout << "MUMPS analysis type: " << paramStr->getStringParameter(Params::mumpsanalysis) << endl;}
-
-    std::random_device rd;  // seed the random number generator
-    std::mt19937 gen(rd()); // use the Mersenne Twister 19937 generator
-    std::uniform_real_distribution<double> dis(-0.01, 0.01); // create a uniform distribution of doubles between 0 and 1
-    fieldMorphogens->setInitialCondition("c", [&gen, &dis](double x, double y){
-        return 1.0 + dis(gen);
-    });
-    fieldMorphogens->setInitialCondition("h", [&dis, &gen](double x, double y) {
-        return 1.0 + dis(gen);
-    });
-    fieldMorphogens->setInitialCondition("m", 1.0);
-
-    fieldMorphogens->printFileVtk(paramStr->getStringParameter(Params::prefix) + "_morphogens_0", true);
+    if(problem->myRank()==0){cout << "MUMPS factorization: " << paramStr->getStringParameter(Params::factorization) << endl;}
 
     SmartPtr<MUMPSDirectLinearSolver> linSolReactionDiff = Create<MUMPSDirectLinearSolver>();
     linSolReactionDiff->setHiPerProblem(problem);
@@ -83,7 +107,9 @@ int main(int argc, char** argv) {
     }else{
         linSolReactionDiff->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
     }
+    SetFactorization(linSolReactionDiff, paramStr);
     linSolReactionDiff->Update();
+    memory.mark("linSolReactionDiff analysis");
 
     SmartPtr<NewtonRaphsonNonlinearSolver> nonLinSolReactionDiff = Create<NewtonRaphsonNonlinearSolver>();
     nonLinSolReactionDiff->setLinearSolver(linSolReactionDiff);
@@ -102,12 +128,39 @@ int main(int argc, char** argv) {
     fieldVelocity->setDOFs({"vx", "vy"});
     fieldVelocity->setNodeAuxF({"c", "h", "m"});
     fieldVelocity->Update();
+    memory.mark("fieldVelocity");
+    memory.addDOFsHandler("fieldVelocity", fieldVelocity, 3);
 
     fieldMorphogens->nodeAuxF->mirrorField(0, 0, fieldVelocity->nodeDOFs);
     fieldMorphogens->nodeAuxF->mirrorField(1, 1, fieldVelocity->nodeDOFs);
     fieldVelocity->nodeAuxF->mirrorField(0, 0, fieldMorphogens->nodeDOFs);
     fieldVelocity->nodeAuxF->mirrorField(1, 1, fieldMorphogens->nodeDOFs);
-    fieldVelocity->nodeAuxF->mirrorField(2, 2, fieldMorphogens->nodeDOFs);
+    fieldVelocity->nodeAuxF->mirrorField(2, 0, fieldTransport->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(0, 0, fieldVelocity->nodeDOFs);
+    fieldTransport->nodeAuxF->mirrorField(1, 1, fieldVelocity->nodeDOFs);
+
+    // m is linear and does not feed back into c and h, so it is solved once per step outside Newton
+    SmartPtr<HiPerProblem> problemTransport = Create<HiPerProblem>();
+    problemTransport->setParameterStructure(paramStr);
+    problemTransport->setDOFsHandlers({fieldTransport});
+    problemTransport->setIntegration("IntegTransport", {"transport"});
+    problemTransport->setCubatureGauss("IntegTransport", 3);
+    problemTransport->setElementFillings("IntegTransport", Transport);
+    problemTransport->Update();
+    memory.mark("problemTransport (matrix graph)");
+
+    SmartPtr<MUMPSDirectLinearSolver> linSolTransport = Create<MUMPSDirectLinearSolver>();
+    linSolTransport->setHiPerProblem(problemTransport);
+    linSolTransport->setVerbosity(MUMPSDirectLinearSolver::Verbosity::None);
+    linSolTransport->setDefaultParameters();
+    if(paramStr->getStringParameter(Params::mumpsanalysis) == "sequential") {
+        linSolTransport->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Sequential);
+    }else{
+        linSolTransport->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
+    }
+    SetFactorization(linSolTransport, paramStr);
+    linSolTransport->Update();
+    memory.mark("linSolTransport analysis");
 
 
     SmartPtr<HiPerProblem> problemFlow = Create<HiPerProblem>();
@@ -117,6 +170,7 @@ int main(int argc, char** argv) {
     problemFlow->setCubatureGauss("IntegFlow", 3);
     problemFlow->setElementFillings("IntegFlow", TensionFlow);
     problemFlow->Update();
+    memory.mark("problemFlow (matrix graph)");
 
     SmartPtr<MUMPSDirectLinearSolver> linSolFlow = Create<MUMPSDirectLinearSolver>();
     linSolFlow->setHiPerProblem(problemFlow);
@@ -127,61 +181,220 @@ int main(int argc, char** argv) {
     }else{
         linSolFlow->setAnalysisType(MUMPSDirectLinearSolver::AnalysisType::Parallel);
     }
+    SetFactorization(linSolFlow, paramStr);
     linSolFlow->Update();
-
-    fieldVelocity->nodeAuxF->setValue(fieldMorphogens->nodeDOFs);
-    problemFlow->UpdateGhosts();
-    linSolFlow->solve();
-    linSolFlow->UpdateSolution();
-    fieldVelocity->printFileVtk(paramStr->getStringParameter(Params::prefix) +"_velocity_0", true);
-
-    double &dt = paramStr->getRealParameter(Params::dt);
-
-    for(int i = 1; i < 8000; i++) {
-        if(problem->myRank() == 0)
-            std::cout << "step: " << i << " : dt: " << dt << endl;
-
-        fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
-        fieldMorphogens->UpdateGhosts();
-
-        nonLinSolReactionDiff->solve();
-
-        if(nonLinSolReactionDiff->converged()){
-            if(nonLinSolReactionDiff->numberOfIterations() <= 5)
-                dt *= 1.1;
-            else if(nonLinSolReactionDiff->numberOfIterations() > 7)
-                dt *= 0.9;
-
-            std::string fileI = paramStr->getStringParameter(Params::prefix) + "_morphogens_" + to_string(i);
-            fieldMorphogens->printFileVtk(fileI, true);
-        }
-        else {
-            fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
-            dt *= 0.8;
-            i--;
-
-            if(dt < 1e-10)
-                break;
-
-            continue;
-        }
-
+    memory.mark("linSolFlow analysis");
+
+    GhostExchange ghosts(mesh);
+
+    // Mesh, DOFsHandlers, problems and MUMPS analyses are shared by all the members of an ensemble
+    EnsembleParameters ensembleParams(paramStr);
+    for(const EnsembleMember& member : ReadEnsemble(paramStr)) {
+        ensembleParams.apply(member);
+        const std::string prefix = member.prefix;
+        SaveParamsToConfigFile(paramStr, prefix + "_config.txt");
+
+        // Perturbations keyed on the node position: identical for any partition and visiting order
+        const uint32_t seed = SeedFromParameter(paramStr->getRealParameter(Params::seed));
+        fieldMorphogens->setInitialCondition("c", [seed](double x, double y){
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 0) - 1.0);
+        });
+        fieldMorphogens->setInitialCondition("h", [seed](double x, double y) {
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 1) - 1.0);
+        });
+        fieldTransport->setInitialCondition("m", 1.0);
+
+        PatternAnalysis analysis(fieldMorphogens, 0, PatternAnalysis::Geometry::Periodic,
+                                 static_cast<int>(paramStr->getRealParameter(Params::analysisbins)), domainLength, prefix + "_pattern.txt");
+        const int analysisEvery = static_cast<int>(paramStr->getRealParameter(Params::analysisevery));
+        const int outputEvery = static_cast<int>(paramStr->getRealParameter(Params::outputevery));
+
+        fieldMorphogens->printFileVtk(prefix + "_morphogens_0", true);
+        fieldTransport->printFileVtk(prefix + "_transport_0", true);
+
+        fieldVelocity->nodeAuxF->setValue(0, 0, fieldMorphogens->nodeDOFs);
+        fieldVelocity->nodeAuxF->setValue(1, 1, fieldMorphogens->nodeDOFs);
+        fieldVelocity->nodeAuxF->setValue(2, 0, fieldTransport->nodeDOFs);
         problemFlow->UpdateGhosts();
-
-        linSolFlow->solve();
+        SolveWithFallback(linSolFlow);
+        memory.markOnce("linSolFlow factorization");
+        memory.addFactorization("linSolFlow", linSolFlow);
         linSolFlow->UpdateSolution();
-
-        const double cflDt = CheckCFL(fieldVelocity);
-        if(cflDt < dt) {
-            const double newDt = 0.9*cflDt;
+        ghosts.markDirty(fieldMorphogens->nodeAuxF);     // vx and vy mirror the velocity
+        fieldVelocity->printFileVtk(prefix + "_velocity_0", true);
+
+        double &dt = paramStr->getRealParameter(Params::dt);
+        const double steadyTol = paramStr->getRealParameter(Params::steadytol);
+        bool pseudoTransient{false};
+        double time{};
+
+        RunSummary summary(MPI_COMM_WORLD);
+        // Every count is written even when it stays 0, so that a baseline without rejections still catches them
+        summary.count("newton_iterations", 0);
+        summary.count("rejected_steps", 0);
+        summary.count("steps", 0);
+        const int lastStep = paramStr->getRealParameter(Params::nsteps) > 0.0 ? static_cast<int>(paramStr->getRealParameter(Params::nsteps)) : 7999;
+        for(int i = 1; i <= lastStep; i++) {
             if(problem->myRank() == 0)
-                std::cout << "Warning!!! cfl condition is not satisfied, decreasing time step. Current dt: " << i << " : dt: " << paramStr->getRealParameter(Params::dt) << " -> new dt: " << newDt << endl;
-            dt = newDt;
+                std::cout << "step: " << i << " : dt: " << dt << endl;
+
+            const double stepDt = dt;
+            const bool writeFields = outputEvery > 0 and i % outputEvery == 0;
+            SampledConsistency::instance().beginStep(i);
+            fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
+            ghosts.markDirty(fieldMorphogens->nodeDOFs0);
+            ghosts.flush();
+
+            summary.begin("newton");
+            nonLinSolReactionDiff->solve();
+            CheckFactorization(linSolReactionDiff);
+            summary.end("newton");
+            summary.count("newton_iterations", nonLinSolReactionDiff->numberOfIterations());
+            memory.markOnce("linSolReactionDiff factorization");
+            memory.addFactorization("linSolReactionDiff", linSolReactionDiff);
+
+            if(nonLinSolReactionDiff->converged()){
+                if(pseudoTransient)
+                    dt *= paramStr->getRealParameter(Params::ptcgrowth);
+                else if(nonLinSolReactionDiff->numberOfIterations() <= 5)
+                    dt *= 1.1;
+                else if(nonLinSolReactionDiff->numberOfIterations() > 7)
+                    dt *= 0.9;
+
+                if(writeFields) {
+                    summary.begin("output");
+                    std::string fileI = prefix + "_morphogens_" + to_string(i);
+                    fieldMorphogens->printFileVtk(fileI, true);
+                    memory.markOnce("output buffers");
+                    summary.end("output");
+                }
+            }
+            else {
+                summary.count("rejected_steps");
+                fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
+                dt *= 0.8;
+                i--;
+
+                if(dt < 1e-10)
+                    break;
+
+                continue;
+            }
+
+            summary.begin("transport");
+            fieldTransport->nodeDOFs0->setValue(fieldTransport->nodeDOFs);
+            problemTransport->UpdateGhosts();
+            SolveWithFallback(linSolTransport);
+            memory.markOnce("linSolTransport factorization");
+            memory.addFactorization("linSolTransport", linSolTransport);
+            summary.end("transport");
+
+            // A failed m solve rejects the whole step, as a failed Newton solve does
+            if(!linSolTransport->converged()) {
+                if(problem->myRank() == 0)
+                    std::cout << "Transport solve has not converged, rejecting the step." << endl;
+                summary.count("rejected_steps");
+                fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
+                dt = 0.8 * stepDt;
+                i--;
+
+                if(dt < 1e-10)
+                    break;
+
+                continue;
+            }
+            linSolTransport->UpdateSolution();
+
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileTI = prefix + "_transport_" + to_string(i);
+                fieldTransport->printFileVtk(fileTI, true);
+                summary.end("output");
+            }
+
+            summary.begin("flow");
+            problemFlow->UpdateGhosts();
+
+            fieldVelocity->nodeDOFs0->setValue(fieldVelocity->nodeDOFs);
+            SolveWithFallback(linSolFlow);
+            linSolFlow->UpdateSolution();
+            ghosts.markDirty(fieldMorphogens->nodeAuxF);
+            summary.end("flow");
+            time += stepDt;
+            summary.count("steps");
+
+            if(writeFields) {
+                summary.begin("output");
+                std::string fileI = prefix + "_velocity_" + to_string(i);
+                fieldVelocity->printFileVtk(fileI, true);
+                summary.end("output");
+            }
+            if(analysisEvery > 0 and i % analysisEvery == 0) {
+                summary.begin("analysis");
+                analysis.analyze(i, time);
+                summary.end("analysis");
+            }
+
+            const double rateC = FieldChange(fieldMorphogens, 0) / stepDt;
+            const double rateH = FieldChange(fieldMorphogens, 1) / stepDt;
+            const double rateV = std::max(FieldChange(fieldVelocity, 0), FieldChange(fieldVelocity, 1)) / stepDt;
+            if(problem->myRank() == 0)
+                std::cout << "rates of change: c: " << rateC << " h: " << rateH << " v: " << rateV << endl;
+
+            if(!pseudoTransient and steadyTol > 0.0 and std::max({rateC, rateH, rateV}) < steadyTol) {
+                pseudoTransient = true;
+                if(problem->myRank() == 0)
+                    std::cout << "Pattern is stationary at step " << i << ", t = " << time << ". Switching to pseudo-transient continuation." << endl;
+            }
+
+            // The CFL bound only matters for the transient; pseudo-transient steps aim at the steady state
+            const double cflDt = CheckCFL(fieldVelocity);
+            if(!pseudoTransient and cflDt < dt) {
+                const double newDt = 0.9*cflDt;
+                if(problem->myRank() == 0)
+                    std::cout << "Warning!!! cfl condition is not satisfied, decreasing time step. Current dt: " << i << " : dt: " << paramStr->getRealParameter(Params::dt) << " -> new dt: " << newDt << endl;
+                dt = newDt;
+            }
+
+            if(pseudoTransient and dt >= paramStr->getRealParameter(Params::dtsteady)) {
+                // Steady Newton solve: with dt -> infinity the time derivative drops out of the residual
+                const double lastDt = dt;
+                dt = 1.E30;
+                fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
+                ghosts.markDirty(fieldMorphogens->nodeDOFs0);
+                ghosts.flush();
+                summary.begin("newton");
+                nonLinSolReactionDiff->solve();
+                CheckFactorization(linSolReactionDiff);
+                summary.end("newton");
+                summary.count("newton_iterations", nonLinSolReactionDiff->numberOfIterations());
+
+                const bool steadyConverged = nonLinSolReactionDiff->converged();
+                if(!steadyConverged)
+                    fieldMorphogens->nodeDOFs->setValue(fieldMorphogens->nodeDOFs0);
+                dt = lastDt;
+
+                fieldMorphogens->printFileVtk(prefix + "_morphogens_steady", true);
+                if(problem->myRank() == 0) {
+                    std::cout << "Steady state report: step " << i << ", t = " << time << ", last dt = " << lastDt
+                              << ", steady Newton " << (steadyConverged ? "converged" : "did not converge, keeping the last pseudo-transient state")
+                              << ", |dc/dt| = " << rateC << ", |dh/dt| = " << rateH << ", |dv/dt| = " << rateV << endl;
+                }
+                break;
+            }
         }
 
-        std::string fileI = paramStr->getStringParameter(Params::prefix) + "_velocity_" + to_string(i);
-        fieldVelocity->printFileVtk(fileI, true); 
+        summary.value("time", time);
+        summary.value("mean_c", FieldMean(fieldMorphogens, 0));
+        summary.value("mean_h", FieldMean(fieldMorphogens, 1));
+        summary.value("mean_m", FieldMean(fieldTransport, 0));
+        summary.write(prefix + "_summary.txt");
     }
 
+    ghosts.report(MPI_COMM_WORLD);
+    if(paramStr->getStringParameter(Params::consistency) == "sampled")
+        SampledConsistency::instance().report(MPI_COMM_WORLD, paramStr->getStringParameter(Params::prefix) + "_consistency.txt");
+    memory.report(paramStr->getStringParameter(Params::prefix) + "_memory.txt");
+
     hiperlife::Finalize();
 }
@@ -0,0 +1,99 @@
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "Ensemble.h"
+
+namespace
+{
+    const std::map<std::string, Params::RealParameters>& realParameterNames()
+    {
+        static const std::map<std::string, Params::RealParameters> names{
+                {"dt", Params::dt},
+                {"dA", Params::dA},
+                {"dB", Params::dB},
+                {"k", Params::k},
+                {"dc", Params::dc},
+                {"dh", Params::dh},
+                {"rhoc", Params::rhoc},
+                {"rhoh", Params::rhoh},
+                {"c0", Params::c0},
+                {"cs", Params::cs},
+                {"m0", Params::m0},
+                {"gamma", Params::gamma},
+                {"mu", Params::mu},
+                {"nu", Params::nu},
+                {"lame1", Params::lame1},
+                {"lame2", Params::lame2},
+                {"kp", Params::kp},
+                {"f", Params::f},
+                {"seed", Params::seed},
+                {"steadytol", Params::steadytol},
+                {"ptcgrowth", Params::ptcgrowth},
+                {"dtsteady", Params::dtsteady},
+                {"analysisevery", Params::analysisevery},
+                {"analysisbins", Params::analysisbins},
+                {"outputevery", Params::outputevery}
+        };
+        return names;
+    }
+}
+
+std::vector<EnsembleMember> ReadEnsemble(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr)
+{
+    const std::string prefix = paramStr->getStringParameter(Params::prefix);
+    const std::string fileName = paramStr->getStringParameter(Params::ensemble);
+    if(fileName.empty())
+        return {EnsembleMember{prefix, {}}};
+
+    std::ifstream in(fileName);
+    if(!in) {
+        std::cerr << "ReadEnsemble failed. Cannot open " << fileName << std::endl;
+        abort();
+    }
+
+    std::vector<EnsembleMember> members;
+    std::string line;
+    while(std::getline(in, line)) {
+        std::istringstream tokens(line);
+        std::string name;
+        if(!(tokens >> name) or name[0] == '#')
+            continue;
+
+        EnsembleMember member{prefix + "_" + name, {}};
+        std::string token;
+        while(tokens >> token) {
+            const size_t eq = token.find('=');
+            const auto param = realParameterNames().find(token.substr(0, eq));
+            if(eq == std::string::npos or param == realParameterNames().end()) {
+                std::cerr << "ReadEnsemble failed. Unknown real parameter in '" << token << "' of member " << name << std::endl;
+                abort();
+            }
+            member.values.emplace_back(param->second, std::stod(token.substr(eq + 1)));
+        }
+        members.push_back(member);
+    }
+
+    if(members.empty()) {
+        std::cerr << "ReadEnsemble failed. No members in " << fileName << std::endl;
+        abort();
+    }
+
+    return members;
+}
+
+EnsembleParameters::EnsembleParameters(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr)
+    : _paramStr(paramStr)
+{
+    for(const auto& [name, param] : realParameterNames())
+        _base.emplace_back(param, paramStr->getRealParameter(param));
+}
+
+void EnsembleParameters::apply(const EnsembleMember& member)
+{
+    for(const auto& [param, value] : _base)
+        _paramStr->setRealParameter(param, value);
+    for(const auto& [param, value] : member.values)
+        _paramStr->setRealParameter(param, value);
+}
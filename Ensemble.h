@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hl_ParamStructure.h>
+
+#include "Physics.h"
+
+// One member of a parameter sweep: the real parameters it overrides and the prefix of its output files.
+struct EnsembleMember
+{
+    std::string prefix;
+    std::vector<std::pair<Params::RealParameters, double>> values;
+};
+
+// Reads the members listed in the file given by the "ensemble" parameter. Each non-empty line that
+// does not start with '#' describes one member as
+//     name param=value param=value ...
+// and its output is written with prefix "<prefix>_<name>". A file without members is an error. Without an
+// ensemble file a single member reproduces the command line parameters.
+std::vector<EnsembleMember> ReadEnsemble(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr);
+
+// Restores the real parameters read from the command line and applies the overrides of the member,
+// so that members never inherit the time step or any other value left by the previous one.
+class EnsembleParameters
+{
+public:
+    explicit EnsembleParameters(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr);
+
+    void apply(const EnsembleMember& member);
+
+private:
+    hiperlife::SmartPtr<hiperlife::ParamStructure> _paramStr;
+    std::vector<std::pair<Params::RealParameters, double>> _base;
+};
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <unordered_map>
+
+#include "GhostExchange.h"
+
+namespace
+{
+    // Personalized all-to-all of integer lists, out[r] goes to rank r and the result holds what every rank sent
+    std::vector<std::vector<int>> exchangeLists(const std::vector<std::vector<int>>& out, MPI_Comm comm)
+    {
+        const int numRanks = out.size();
+        std::vector<int> sendCounts(numRanks), recvCounts(numRanks), sendOffsets(numRanks), recvOffsets(numRanks);
+        std::vector<int> sendData;
+        for(int r = 0; r < numRanks; r++) {
+            sendCounts[r] = out[r].size();
+            sendOffsets[r] = sendData.size();
+            sendData.insert(sendData.end(), out[r].begin(), out[r].end());
+        }
+        MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+
+        int total{};
+        for(int r = 0; r < numRanks; r++) {
+            recvOffsets[r] = total;
+            total += recvCounts[r];
+        }
+        std::vector<int> recvData(total);
+        MPI_Alltoallv(sendData.data(), sendCounts.data(), sendOffsets.data(), MPI_INT,
+                      recvData.data(), recvCounts.data(), recvOffsets.data(), MPI_INT, comm);
+
+        std::vector<std::vector<int>> in(numRanks);
+        for(int r = 0; r < numRanks; r++)
+            in[r].assign(recvData.begin() + recvOffsets[r], recvData.begin() + recvOffsets[r] + recvCounts[r]);
+        return in;
+    }
+}
+
+GhostExchange::GhostExchange(const hiperlife::SmartPtr<hiperlife::DistributedMesh>& mesh)
+    : _comm(mesh->comm())
+{
+    using namespace hiperlife;
+
+    int rank{}, numRanks{};
+    MPI_Comm_rank(_comm, &rank);
+    MPI_Comm_size(_comm, &numRanks);
+
+    std::unordered_map<int, int> ownedIndex;
+    for(int i = 0; i < mesh->loc_nPts(); i++)
+        ownedIndex.emplace(mesh->loc2glob(i), i);
+
+    // The index type refers to the element: a local element yields the global ids of its nodes, as in CheckCFL
+    std::set<int> ghosts;
+    for(int e = 0; e < mesh->loc_nElem(); e++)
+        for(int gid : mesh->elemNodeNbors(e, IndexType::Local))
+            if(ownedIndex.find(gid) == ownedIndex.end())
+                ghosts.insert(gid);
+
+    // Owners are found through a directory distributed by gid % numRanks: owners register their nodes and
+    // every rank asks for the owners of its ghosts
+    std::vector<std::vector<int>> registered(numRanks), queries(numRanks);
+    for(const auto& [gid, i] : ownedIndex)
+        registered[gid % numRanks].push_back(gid);
+    for(int gid : ghosts)
+        queries[gid % numRanks].push_back(gid);
+
+    std::unordered_map<int, int> directory;
+    const std::vector<std::vector<int>> registrations = exchangeLists(registered, _comm);
+    for(int r = 0; r < numRanks; r++)
+        for(int gid : registrations[r])
+            directory.emplace(gid, r);
+
+    const std::vector<std::vector<int>> asked = exchangeLists(queries, _comm);
+    std::vector<std::vector<int>> replies(numRanks);
+    for(int r = 0; r < numRanks; r++)
+        for(int gid : asked[r])
+            replies[r].push_back(directory.at(gid));
+    const std::vector<std::vector<int>> owners = exchangeLists(replies, _comm);
+
+    // Every rank tells the owners which of their nodes it needs, in the order it will unpack them
+    std::vector<std::vector<int>> requests(numRanks);
+    for(int r = 0; r < numRanks; r++)
+        for(size_t j = 0; j < queries[r].size(); j++)
+            requests[owners[r][j]].push_back(queries[r][j]);
+    const std::vector<std::vector<int>> requested = exchangeLists(requests, _comm);
+
+    for(int r = 0; r < numRanks; r++) {
+        if(r == rank or (requests[r].empty() and requested[r].empty()))
+            continue;
+        Neighbour neighbour{r, {}, requests[r]};
+        for(int gid : requested[r])
+            neighbour.sendLocal.push_back(ownedIndex.at(gid));
+        _neighbours.push_back(std::move(neighbour));
+    }
+}
+
+void GhostExchange::markDirty(const hiperlife::SmartPtr<hiperlife::DistVec>& vec)
+{
+    _requested++;
+    if(std::find(_dirty.begin(), _dirty.end(), vec) == _dirty.end())
+        _dirty.push_back(vec);
+}
+
+void GhostExchange::flush()
+{
+    using namespace hiperlife;
+
+    if(_dirty.empty())
+        return;
+
+    const double start = MPI_Wtime();
+
+    // Values per node: the fields of every dirty vector, in the order the vectors were marked
+    int width{};
+    for(const auto& vec : _dirty)
+        width += vec->numFlds();
+
+    const int numNeighbours = _neighbours.size();
+    std::vector<std::vector<double>> sendBuffers(numNeighbours), recvBuffers(numNeighbours);
+    std::vector<MPI_Request> requests(2 * numNeighbours);
+    for(int k = 0; k < numNeighbours; k++) {
+        recvBuffers[k].resize(width * _neighbours[k].recvGlobal.size());
+        MPI_Irecv(recvBuffers[k].data(), recvBuffers[k].size(), MPI_DOUBLE, _neighbours[k].rank, 0, _comm, &requests[k]);
+    }
+    for(int k = 0; k < numNeighbours; k++) {
+        std::vector<double>& buffer = sendBuffers[k];
+        buffer.reserve(width * _neighbours[k].sendLocal.size());
+        for(int i : _neighbours[k].sendLocal)
+            for(const auto& vec : _dirty)
+                for(int f = 0; f < vec->numFlds(); f++)
+                    buffer.push_back(vec->getValue(f, i, IndexType::Local));
+        MPI_Isend(buffer.data(), buffer.size(), MPI_DOUBLE, _neighbours[k].rank, 0, _comm, &requests[numNeighbours + k]);
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    for(int k = 0; k < numNeighbours; k++) {
+        const double* values = recvBuffers[k].data();
+        for(int gid : _neighbours[k].recvGlobal)
+            for(const auto& vec : _dirty)
+                for(int f = 0; f < vec->numFlds(); f++)
+                    vec->setValue(f, gid, IndexType::Global, *values++);
+    }
+
+    _time += MPI_Wtime() - start;
+    _performed += static_cast<long>(_dirty.size());
+    _messages += numNeighbours;
+    _dirty.clear();
+}
+
+void GhostExchange::report(MPI_Comm comm) const
+{
+    long counts[3] = {_requested, _performed, _messages};
+    long total[3];
+    MPI_Reduce(counts, total, 3, MPI_LONG, MPI_SUM, 0, comm);
+    double time{};
+    MPI_Reduce(&_time, &time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if(rank == 0)
+        std::cout << "Ghost exchanges: " << total[1] << " performed for " << total[0] << " requested, in "
+                  << total[2] << " messages, " << time << " s" << std::endl;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include <hl_HiPerProblem.h>
+
+// Deferred and aggregated ghost updates. Stages mark the node vectors they modify and the exchange is
+// flushed right before the next stage that reads ghost values. A flush packs the owned values of every
+// dirty vector into one message per neighbouring rank, so a stage that modifies several vectors (the mesh
+// motion updates the coordinates, the displacement and its aux fields) costs one round of messages.
+//
+// The pattern is built once from the mesh: the ghosts of a rank are the nodes of its local elements that it
+// does not own. The connectivity does not change during a run, only the coordinates do.
+//
+// markDirty and flush are collective: every rank must mark the same vectors in the same order.
+class GhostExchange
+{
+public:
+    explicit GhostExchange(const hiperlife::SmartPtr<hiperlife::DistributedMesh>& mesh);
+
+    void markDirty(const hiperlife::SmartPtr<hiperlife::DistVec>& vec);
+
+    // Exchanges the pending vectors in one message per neighbour
+    void flush();
+
+    // Vector updates requested through markDirty and performed, and messages sent, summed over the ranks
+    void report(MPI_Comm comm) const;
+
+private:
+    struct Neighbour
+    {
+        int rank;
+        std::vector<int> sendLocal;                  // local indices of owned nodes the neighbour has as ghosts
+        std::vector<int> recvGlobal;                 // global ids of the ghosts owned by the neighbour
+    };
+
+    MPI_Comm _comm;
+    std::vector<Neighbour> _neighbours;
+    std::vector<hiperlife::SmartPtr<hiperlife::DistVec>> _dirty;
+    long _requested{};
+    long _performed{};
+    long _messages{};
+    double _time{};
+};
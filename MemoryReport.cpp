@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "MemoryReport.h"
+
+namespace
+{
+    double residentBytes()
+    {
+        long pages{}, resident{};
+        std::ifstream statm("/proc/self/statm");
+        statm >> pages >> resident;
+        return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+    }
+
+    double peakResidentBytes()
+    {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return 1024.0 * usage.ru_maxrss;                 // kilobytes on Linux
+    }
+
+    std::string megabytes(double bytes)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+        return out.str();
+    }
+}
+
+MemoryReport::MemoryReport(MPI_Comm comm)
+    : _comm(comm), _lastRSS(residentBytes())
+{
+}
+
+void MemoryReport::mark(const std::string& label)
+{
+    const double rss = residentBytes();
+    _entries.push_back({label, rss - _lastRSS, true});
+    _lastRSS = rss;
+}
+
+void MemoryReport::markOnce(const std::string& label)
+{
+    for(const Entry& entry : _entries)
+        if(entry.measured and entry.label == label) {
+            _lastRSS = residentBytes();
+            return;
+        }
+    mark(label);
+}
+
+void MemoryReport::addDOFsHandler(const std::string& label, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int mirroredAuxF)
+{
+    const double nodes = field->mesh->loc_nPts();
+    const double values = 2.0 * field->nodeDOFs->numFlds() + field->nodeAuxF->numFlds() - mirroredAuxF;
+    _entries.push_back({label + " node arrays", values * nodes * sizeof(double), false});
+}
+
+void MemoryReport::addFactorization(const std::string& label, const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver)
+{
+    const double maxMB = linSolver->INFOG(21);
+    const double totalMB = linSolver->INFOG(22);
+    for(Factorization& factorization : _factorizations)
+        if(factorization.label == label) {
+            factorization.maxMB = std::max(factorization.maxMB, maxMB);
+            factorization.totalMB = std::max(factorization.totalMB, totalMB);
+            return;
+        }
+    _factorizations.push_back({label, maxMB, totalMB});
+}
+
+void MemoryReport::report(const std::string& fileName) const
+{
+    int rank{}, numRanks{};
+    MPI_Comm_rank(_comm, &rank);
+    MPI_Comm_size(_comm, &numRanks);
+
+    // Every rank holds the same sequence of entries, so they are reduced in one message per operation
+    std::vector<double> local;
+    for(const Entry& entry : _entries)
+        local.push_back(entry.bytes);
+    local.push_back(residentBytes());
+    local.push_back(peakResidentBytes());
+
+    const int n = local.size();
+    std::vector<double> minBytes(n), maxBytes(n), sumBytes(n);
+    MPI_Reduce(local.data(), minBytes.data(), n, MPI_DOUBLE, MPI_MIN, 0, _comm);
+    MPI_Reduce(local.data(), maxBytes.data(), n, MPI_DOUBLE, MPI_MAX, 0, _comm);
+    MPI_Reduce(local.data(), sumBytes.data(), n, MPI_DOUBLE, MPI_SUM, 0, _comm);
+
+    std::vector<double> peaks(rank == 0 ? numRanks : 0);
+    MPI_Gather(&local[n - 1], 1, MPI_DOUBLE, peaks.data(), 1, MPI_DOUBLE, 0, _comm);
+    if(rank != 0)
+        return;
+
+    std::ostringstream out;
+    out << "Memory report (" << numRanks << " ranks): min / mean / max per rank" << std::endl;
+    auto line = [&](const std::string& label, int i) {
+        out << "  " << std::left << std::setw(44) << label
+            << megabytes(minBytes[i]) << " / " << megabytes(sumBytes[i] / numRanks) << " / " << megabytes(maxBytes[i]) << std::endl;
+    };
+    out << " measured resident set growth:" << std::endl;
+    for(int i = 0; i < static_cast<int>(_entries.size()); i++)
+        if(_entries[i].measured)
+            line(_entries[i].label, i);
+    out << " node array sizes (owned nodes):" << std::endl;
+    for(int i = 0; i < static_cast<int>(_entries.size()); i++)
+        if(!_entries[i].measured)
+            line(_entries[i].label, i);
+    line("current RSS", n - 2);
+    line("peak RSS", n - 1);
+
+    // MUMPS already reduces these over the ranks of the solver
+    if(!_factorizations.empty()) {
+        out << " MUMPS factorization (largest rank / all ranks):" << std::endl;
+        for(const Factorization& factorization : _factorizations)
+            out << "  " << std::left << std::setw(44) << factorization.label << megabytes(factorization.maxMB * 1024.0 * 1024.0)
+                << " / " << megabytes(factorization.totalMB * 1024.0 * 1024.0) << std::endl;
+    }
+
+    const int maxRank = std::max_element(peaks.begin(), peaks.end()) - peaks.begin();
+    out << " largest peak RSS on rank " << maxRank << ": " << megabytes(peaks[maxRank]) << std::endl;
+    std::cout << out.str();
+
+    // The per-rank listing only goes to the file
+    out << " peak RSS per rank:" << std::endl;
+    for(int r = 0; r < numRanks; r++)
+        out << "  " << r << "\t" << megabytes(peaks[r]) << std::endl;
+    std::ofstream(fileName) << out.str();
+}
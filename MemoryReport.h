@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <hl_HiPerProblem.h>
+#include <hl_LinearSolver_Direct_MUMPS.h>
+
+// Per-subsystem memory accounting. Each mark attributes the growth of the resident set since the previous
+// mark to a label, so that marks placed right after building a DOFsHandler, a HiPerProblem, a MUMPS
+// analysis or the first factorization tell which of them sets the per-node memory. The report combines
+// these measurements over all ranks with the size of the DOFsHandler node arrays and the peak RSS.
+class MemoryReport
+{
+public:
+    explicit MemoryReport(MPI_Comm comm);
+
+    void mark(const std::string& label);
+
+    // Marks only the first time the label is seen, for stages inside the time loop
+    void markOnce(const std::string& label);
+
+    // Records the bytes of the owned node arrays (DOFs, DOFs0 and aux fields) of a DOFsHandler. The last
+    // mirroredAuxF aux fields are mirrors of another handler's DOFs and are not counted again.
+    void addDOFsHandler(const std::string& label, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int mirroredAuxF = 0);
+
+    // Records the factorization memory reported by MUMPS after a solve (INFOG(21), the largest rank, and
+    // INFOG(22), the sum over ranks). Repeated calls with a label keep the largest figures.
+    void addFactorization(const std::string& label, const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver);
+
+    void report(const std::string& fileName) const;
+
+private:
+    struct Entry
+    {
+        std::string label;
+        double bytes;
+        bool measured;
+    };
+
+    struct Factorization
+    {
+        std::string label;
+        double maxMB;
+        double totalMB;
+    };
+
+    MPI_Comm _comm;
+    double _lastRSS;
+    std::vector<Entry> _entries;
+    std::vector<Factorization> _factorizations;
+};
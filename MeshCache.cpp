@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <hl_MeshLoader.h>
+
+#include "MeshCache.h"
+
+namespace
+{
+    // Legacy VTK binary data is big endian
+    template<typename T>
+    void writeBigEndian(std::ofstream& out, T value)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+            for(size_t i = 0; i < sizeof(T) / 2; i++)
+                std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+        out.write(reinterpret_cast<const char*>(bytes), sizeof(T));
+    }
+}
+
+std::string MeshCacheFile(const std::string& directory, double h, int numRanks)
+{
+    if(directory.empty())
+        return "";
+
+    std::ostringstream name;
+    // Full precision, so that meshes of nearby sizes never share a file
+    name << directory << "/polygon_tri1_h" << std::setprecision(17) << h << "_np" << numRanks << ".vtk";
+    return name.str();
+}
+
+bool MeshCacheExists(const std::string& fileName, MPI_Comm comm)
+{
+    int rank{};
+    MPI_Comm_rank(comm, &rank);
+
+    int exists{};
+    if(rank == 0)
+        exists = !fileName.empty() and std::ifstream(fileName).good();
+    MPI_Bcast(&exists, 1, MPI_INT, 0, comm);
+
+    return exists;
+}
+
+void WriteMeshCache(const hiperlife::SmartPtr<hiperlife::DistributedMesh>& mesh, const std::string& fileName, MPI_Comm comm)
+{
+    using namespace hiperlife;
+    using std::vector;
+
+    int rank{}, numRanks{};
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    // Per triangle: three global node ids followed by the coordinates of the three nodes
+    constexpr int elemSize = 12;
+    vector<double> local;
+    local.reserve(elemSize * mesh->loc_nElem());
+    for(int e = 0; e < mesh->loc_nElem(); e++) {
+        vector<int> elemNodes = mesh->elemNodeNbors(e, IndexType::Local);
+        vector<double> elemCoords = mesh->elemNborNodeCoords(e, IndexType::Local);
+        for(int n = 0; n < 3; n++)
+            local.push_back(elemNodes[n]);
+        local.insert(local.end(), elemCoords.begin(), elemCoords.begin() + 9);
+    }
+
+    int localSize = local.size();
+    vector<int> sizes(numRanks), offsets(numRanks);
+    MPI_Gather(&localSize, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, comm);
+    int totalSize{};
+    for(int r = 0; r < numRanks; r++) {
+        offsets[r] = totalSize;
+        totalSize += sizes[r];
+    }
+
+    vector<double> global(rank == 0 ? totalSize : 0);
+    MPI_Gatherv(local.data(), localSize, MPI_DOUBLE, global.data(), sizes.data(), offsets.data(), MPI_DOUBLE, 0, comm);
+
+    const std::string tmpName = fileName + ".tmp";
+    int written{};
+    if(rank == 0) {
+        // Gatherv keeps the cells rank by rank. The nodes are numbered in order of first appearance, so that
+        // they follow the partition as well.
+        const int numElems = totalSize / elemSize;
+        std::map<long, int> index;
+        vector<double> coords;
+        for(int e = 0; e < numElems; e++)
+            for(int n = 0; n < 3; n++)
+                if(index.emplace(static_cast<long>(global[elemSize * e + n]), index.size()).second) {
+                    const double* x = &global[elemSize * e + 3 + 3 * n];
+                    coords.insert(coords.end(), x, x + 3);
+                }
+
+        std::ofstream out(tmpName, std::ios::binary);
+        out << "# vtk DataFile Version 3.0\n" << "hiperlife mesh cache\n" << "BINARY\n" << "DATASET UNSTRUCTURED_GRID\n";
+
+        out << "POINTS " << index.size() << " double\n";
+        for(double x : coords)
+            writeBigEndian(out, x);
+
+        out << "\nCELLS " << numElems << " " << 4 * numElems << "\n";
+        for(int e = 0; e < numElems; e++) {
+            writeBigEndian<int32_t>(out, 3);
+            for(int n = 0; n < 3; n++)
+                writeBigEndian<int32_t>(out, index.at(static_cast<long>(global[elemSize * e + n])));
+        }
+
+        out << "\nCELL_TYPES " << numElems << "\n";
+        for(int e = 0; e < numElems; e++)
+            writeBigEndian<int32_t>(out, 5);  // VTK_TRIANGLE
+        out << "\n";
+
+        // A stream that failed to open or to write ignores the rest, so one check covers both
+        out.close();
+        written = !out.fail();
+        if(!written) {
+            std::remove(tmpName.c_str());
+            std::cerr << "Warning: cannot write the mesh cache " << tmpName << ", not cached" << std::endl;
+        }
+    }
+    MPI_Bcast(&written, 1, MPI_INT, 0, comm);
+    if(!written)
+        return;
+
+    // Read the temporary file back the way the driver will, without rebalancing
+    bool valid;
+    {
+        SmartPtr<MeshLoader> meshLoader = Create<MeshLoader>();
+        meshLoader->setMesh(ElemType::Triang, BasisFuncType::Linear, 1);
+        meshLoader->loadVtk(tmpName, MeshType::Parallel);
+
+        SmartPtr<DistributedMesh> loaded = Create<DistributedMesh>();
+        loaded->setMesh(meshLoader);
+        loaded->setBalanceMesh(false);
+        loaded->Update();
+        valid = loaded->nElem() == mesh->nElem() and loaded->nPts() == mesh->nPts();
+    }
+
+    // Rename only a verified file, so that a concurrent launch never reads a partial or broken cache
+    if(rank == 0) {
+        if(valid)
+            std::rename(tmpName.c_str(), fileName.c_str());
+        else {
+            std::remove(tmpName.c_str());
+            std::cerr << "Warning: mesh cache " << fileName << " does not read back as the generated mesh, not cached" << std::endl;
+        }
+    }
+    MPI_Barrier(comm);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include <hl_HiPerProblem.h>
+
+// Cache of generated meshes. The polygon generated for the ALE driver is written once as a binary legacy
+// VTK file named after the generator parameters and the number of ranks. The cells are stored rank by rank
+// in the order of the balanced partition, so later launches with the same number of ranks load it with
+// MeshLoader and skip both the meshing and the rebalance.
+
+// Cache file of the polygon mesh of size h partitioned over numRanks, empty when caching is disabled
+std::string MeshCacheFile(const std::string& directory, double h, int numRanks);
+
+bool MeshCacheExists(const std::string& fileName, MPI_Comm comm);
+
+// Gathers the local triangles of every rank and writes them from rank 0. The file is then loaded back and
+// compared with the mesh; on a mismatch it is removed with a warning, so a bad cache is never reused. A file
+// that cannot be written is skipped with a warning as well.
+void WriteMeshCache(const hiperlife::SmartPtr<hiperlife::DistributedMesh>& mesh, const std::string& fileName, MPI_Comm comm);
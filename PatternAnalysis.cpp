@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "PatternAnalysis.h"
+
+PatternAnalysis::PatternAnalysis(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld, Geometry geometry,
+                                 int numBins, double length, const std::string& fileName)
+    : _field(field), _fld(fld), _geometry(geometry), _numBins(numBins), _length(length), _fileName(fileName)
+{
+    MPI_Comm_rank(_field->comm(), &_rank);
+    if(_rank == 0) {
+        std::ofstream out(_fileName);
+        out << "# step\ttime\twavenumber\twavelength\tpeaks\tcontrast\tmean" << std::endl;
+    }
+}
+
+std::vector<double> PatternAnalysis::profile(double& extent) const
+{
+    using namespace hiperlife;
+
+    DistributedMesh& mesh = *_field->mesh;
+    const int nPts = mesh.loc_nPts();
+
+    // Origin of the profile: left end of the periodic box or centroid of the nodes
+    double origin[3]{};
+    if(_geometry == Geometry::Periodic) {
+        double xMin{1.E300};
+        for(int i = 0; i < nPts; i++)
+            xMin = std::min(xMin, mesh._nodeData->getValue(0, i, IndexType::Local));
+        MPI_Allreduce(MPI_IN_PLACE, &xMin, 1, MPI_DOUBLE, MPI_MIN, _field->comm());
+        origin[0] = xMin;
+        extent = _length;
+    }
+    else {
+        for(int i = 0; i < nPts; i++) {
+            origin[0] += mesh._nodeData->getValue(0, i, IndexType::Local);
+            origin[1] += mesh._nodeData->getValue(1, i, IndexType::Local);
+        }
+        origin[2] = nPts;
+        MPI_Allreduce(MPI_IN_PLACE, origin, 3, MPI_DOUBLE, MPI_SUM, _field->comm());
+        origin[0] /= origin[2];
+        origin[1] /= origin[2];
+
+        extent = 0.0;
+        for(int i = 0; i < nPts; i++)
+            extent = std::max(extent, std::hypot(mesh._nodeData->getValue(0, i, IndexType::Local) - origin[0],
+                                                 mesh._nodeData->getValue(1, i, IndexType::Local) - origin[1]));
+        MPI_Allreduce(MPI_IN_PLACE, &extent, 1, MPI_DOUBLE, MPI_MAX, _field->comm());
+    }
+
+    // Bin sums followed by bin counts, reduced in a single message
+    std::vector<double> bins(2 * _numBins);
+    for(int i = 0; i < nPts; i++) {
+        const double x = mesh._nodeData->getValue(0, i, IndexType::Local) - origin[0];
+        const double y = mesh._nodeData->getValue(1, i, IndexType::Local) - origin[1];
+        const double coord = _geometry == Geometry::Periodic ? x : std::hypot(x, y);
+        const int bin = std::clamp(static_cast<int>(coord / extent * _numBins), 0, _numBins - 1);
+        bins[bin] += _field->nodeDOFs->getValue(_fld, i, IndexType::Local);
+        bins[_numBins + bin] += 1.0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, bins.data(), 2 * _numBins, MPI_DOUBLE, MPI_SUM, _field->comm());
+
+    // Empty bins (coarse meshes, bins near the centroid) take the value of the previous filled one
+    std::vector<double> values(_numBins);
+    double last{};
+    for(int b = 0; b < _numBins; b++)
+        if(bins[_numBins + b] > 0.0) {
+            last = bins[b] / bins[_numBins + b];
+            break;
+        }
+    for(int b = 0; b < _numBins; b++) {
+        if(bins[_numBins + b] > 0.0)
+            last = bins[b] / bins[_numBins + b];
+        values[b] = last;
+    }
+
+    return values;
+}
+
+std::vector<double> PatternAnalysis::grid(int& side) const
+{
+    using namespace hiperlife;
+
+    DistributedMesh& mesh = *_field->mesh;
+    const int nPts = mesh.loc_nPts();
+
+    // At most one cell per node spacing, so that a structured mesh fills every cell
+    side = std::max(2, std::min(_numBins, static_cast<int>(std::lround(std::sqrt(static_cast<double>(mesh.nPts()))))));
+
+    double origin[2]{1.E300, 1.E300};
+    for(int i = 0; i < nPts; i++) {
+        origin[0] = std::min(origin[0], mesh._nodeData->getValue(0, i, IndexType::Local));
+        origin[1] = std::min(origin[1], mesh._nodeData->getValue(1, i, IndexType::Local));
+    }
+    MPI_Allreduce(MPI_IN_PLACE, origin, 2, MPI_DOUBLE, MPI_MIN, _field->comm());
+
+    // Cell sums followed by cell counts. Cells are centred on the nodes of a matching structured mesh, and
+    // the last half cell wraps around to the first one.
+    const int numCells = side * side;
+    std::vector<double> cells(2 * numCells);
+    for(int i = 0; i < nPts; i++) {
+        int index[2];
+        for(int d = 0; d < 2; d++) {
+            const double coord = mesh._nodeData->getValue(d, i, IndexType::Local) - origin[d];
+            index[d] = static_cast<int>(std::floor(coord / _length * side + 0.5)) % side;
+            index[d] = (index[d] + side) % side;
+        }
+        const int cell = side * index[1] + index[0];
+        cells[cell] += _field->nodeDOFs->getValue(_fld, i, IndexType::Local);
+        cells[numCells + cell] += 1.0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, cells.data(), 2 * numCells, MPI_DOUBLE, MPI_SUM, _field->comm());
+
+    // Empty cells (unstructured or coarser meshes) take the mean of the filled ones
+    double sum{}, count{};
+    for(int c = 0; c < numCells; c++) {
+        sum += cells[c];
+        count += cells[numCells + c];
+    }
+    std::vector<double> values(numCells);
+    for(int c = 0; c < numCells; c++)
+        values[c] = cells[numCells + c] > 0.0 ? cells[c] / cells[numCells + c] : sum / count;
+
+    return values;
+}
+
+void PatternAnalysis::analyze(int step, double time)
+{
+    if(_geometry == Geometry::PeriodicSquare) {
+        analyzeSquare(step, time);
+        return;
+    }
+
+    double extent{};
+    const std::vector<double> values = profile(extent);
+
+    if(_rank != 0)
+        return;
+
+    const int n = _numBins;
+    double mean{}, vMin{values[0]}, vMax{values[0]};
+    for(double v : values) {
+        mean += v;
+        vMin = std::min(vMin, v);
+        vMax = std::max(vMax, v);
+    }
+    mean /= n;
+
+    // Power spectrum of the mean-free profile; the dominant mode skips the constant one
+    int dominant{};
+    double maxPower{};
+    for(int k = 1; k <= n / 2; k++) {
+        double re{}, im{};
+        for(int b = 0; b < n; b++) {
+            const double phase = 2.0 * M_PI * k * b / n;
+            re += (values[b] - mean) * std::cos(phase);
+            im -= (values[b] - mean) * std::sin(phase);
+        }
+        const double power = re * re + im * im;
+        if(power > maxPower) {
+            maxPower = power;
+            dominant = k;
+        }
+    }
+    const double wavenumber = 2.0 * M_PI * dominant / extent;
+    const double wavelength = dominant > 0 ? extent / dominant : 0.0;
+
+    // Local maxima above the mean; the periodic profile wraps around
+    int peaks{};
+    const bool periodic = _geometry == Geometry::Periodic;
+    for(int b = 0; b < n; b++) {
+        if(!periodic and (b == 0 or b == n - 1))
+            continue;
+        const double prev = values[(b + n - 1) % n];
+        const double next = values[(b + 1) % n];
+        if(values[b] > mean and values[b] > prev and values[b] >= next)
+            peaks++;
+    }
+
+    const double contrast = vMax + vMin != 0.0 ? (vMax - vMin) / (vMax + vMin) : 0.0;
+
+    std::ofstream out(_fileName, std::ios::app);
+    out << step << "\t" << time << "\t" << wavenumber << "\t" << wavelength << "\t" << peaks << "\t" << contrast << "\t" << mean << "\n";
+}
+
+void PatternAnalysis::analyzeSquare(int step, double time)
+{
+    int n{};
+    const std::vector<double> values = grid(n);
+
+    if(_rank != 0)
+        return;
+
+    double mean{}, vMin{values[0]}, vMax{values[0]};
+    for(double v : values) {
+        mean += v;
+        vMin = std::min(vMin, v);
+        vMax = std::max(vMax, v);
+    }
+    mean /= n * n;
+
+    // Two dimensional DFT of the mean-free grid, along x and then along y, with a table of the n roots of unity
+    std::vector<double> cosTable(n), sinTable(n);
+    for(int j = 0; j < n; j++) {
+        cosTable[j] = std::cos(2.0 * M_PI * j / n);
+        sinTable[j] = std::sin(2.0 * M_PI * j / n);
+    }
+    std::vector<double> rowRe(n * n), rowIm(n * n);
+    for(int y = 0; y < n; y++)
+        for(int kx = 0; kx < n; kx++) {
+            double re{}, im{};
+            for(int x = 0; x < n; x++) {
+                const double v = values[n * y + x] - mean;
+                re += v * cosTable[(kx * x) % n];
+                im -= v * sinTable[(kx * x) % n];
+            }
+            rowRe[n * y + kx] = re;
+            rowIm[n * y + kx] = im;
+        }
+
+    // Power summed over rings of integer radius |k|; the dominant ring skips the constant mode
+    std::vector<double> ringPower(n / 2 + 1);
+    for(int ky = 0; ky < n; ky++)
+        for(int kx = 0; kx < n; kx++) {
+            double re{}, im{};
+            for(int y = 0; y < n; y++) {
+                const double c = cosTable[(ky * y) % n];
+                const double s = sinTable[(ky * y) % n];
+                re += rowRe[n * y + kx] * c + rowIm[n * y + kx] * s;
+                im += rowIm[n * y + kx] * c - rowRe[n * y + kx] * s;
+            }
+            const int fx = std::min(kx, n - kx);
+            const int fy = std::min(ky, n - ky);
+            const int ring = static_cast<int>(std::lround(std::hypot(fx, fy)));
+            if(ring <= n / 2)
+                ringPower[ring] += re * re + im * im;
+        }
+
+    int dominant{};
+    double maxPower{};
+    for(int k = 1; k <= n / 2; k++)
+        if(ringPower[k] > maxPower) {
+            maxPower = ringPower[k];
+            dominant = k;
+        }
+    const double wavenumber = 2.0 * M_PI * dominant / _length;
+    const double wavelength = dominant > 0 ? _length / dominant : 0.0;
+
+    // Local maxima above the mean over the four periodic neighbours: spots, or stripe segments
+    int peaks{};
+    for(int y = 0; y < n; y++)
+        for(int x = 0; x < n; x++) {
+            const double v = values[n * y + x];
+            if(v > mean and v > values[n * y + (x + n - 1) % n] and v >= values[n * y + (x + 1) % n]
+                        and v > values[n * ((y + n - 1) % n) + x] and v >= values[n * ((y + 1) % n) + x])
+                peaks++;
+        }
+
+    const double contrast = vMax + vMin != 0.0 ? (vMax - vMin) / (vMax + vMin) : 0.0;
+
+    std::ofstream out(_fileName, std::ios::app);
+    out << step << "\t" << time << "\t" << wavenumber << "\t" << wavelength << "\t" << peaks << "\t" << contrast << "\t" << mean << "\n";
+}
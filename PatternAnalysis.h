@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <hl_HiPerProblem.h>
+
+// In-situ characterization of a Turing pattern. The field is binned on the fly, and each call appends one
+// line with the dominant wavenumber, wavelength, peak count and contrast of the pattern to a text file. This
+// replaces dumping every field just to post-process its wavelength.
+//
+// The profile along x only describes quasi-one dimensional periodic domains, such as the genRectangle(n, 1)
+// strip of the periodic driver: on a square it averages spots and labyrinths away. Periodic squares are
+// binned on a two dimensional grid instead, and the wavenumber is the peak of its radially binned spectrum.
+class PatternAnalysis
+{
+public:
+    enum class Geometry
+    {
+        Periodic,                                    // profile along x, periodic with the given length
+        PeriodicSquare,                              // grid over the periodic square of the given side, at most
+                                                     // numBins cells and one cell per node spacing along each axis
+        Radial                                       // profile along the distance to the centroid
+    };
+
+    PatternAnalysis(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld, Geometry geometry,
+                    int numBins, double length, const std::string& fileName);
+
+    void analyze(int step, double time);
+
+private:
+    std::vector<double> profile(double& extent) const;
+
+    // Cell averages on a side x side grid over the periodic square, row by row along y
+    std::vector<double> grid(int& side) const;
+
+    void analyzeSquare(int step, double time);
+
+    hiperlife::SmartPtr<hiperlife::DOFsHandler> _field;
+    int _fld;
+    Geometry _geometry;
+    int _numBins;
+    double _length;
+    std::string _fileName;
+    int _rank;
+};
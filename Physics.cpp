@@ -1,8 +1,185 @@
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+
 #include <hl_GlobalBasisFunctions.h>
 #include <hl_HiPerProblem.h>
 
+#include "GhostExchange.h"
 #include "Physics.h"
 
+namespace
+{
+    constexpr int P1 = 3;                            // nodes of a linear triangle
+
+    // Gauss point data of a linear triangle, stored as flat arrays so that the block loops
+    // of FillMorphogenBlocks run over contiguous memory.
+    struct P1Point
+    {
+        double jac;
+        double dt;
+        double bf[P1];
+        double dbfdx[P1][2];
+        double adv[2];                               // advecting velocity (material minus mesh velocity)
+        double divVel;                               // divergence of the material velocity
+    };
+
+    bool isP1Triangle(const hiperlife::SubFillStructure& subFill)
+    {
+        return subFill.eNN == P1 and subFill.pDim == 2;
+    }
+
+    // Assembly options of Params::massmatrix and Params::quadrature
+    bool lumpedMass{false};
+    bool splitDiffusion{false};
+
+    // Solvers set to block-low-rank by SetFactorization and their backward error tolerance
+    std::map<const hiperlife::MUMPSDirectLinearSolver*, double> blrSolvers;
+
+    void loadP1Point(P1Point& p, hiperlife::SubFillStructure& subFill, ttl::tensor<double,2>& Dbfdx,
+                     double jac, double dt, const double* nborAux, int numAuxF, int velOffset)
+    {
+        p.jac = jac;
+        p.dt = dt;
+        const double* bf = subFill.nborBFs();
+        p.divVel = 0.0;
+        p.adv[0] = p.adv[1] = 0.0;
+        for(int I = 0; I < P1; I++) {
+            p.bf[I] = bf[I];
+            p.dbfdx[I][0] = Dbfdx(I, 0);
+            p.dbfdx[I][1] = Dbfdx(I, 1);
+
+            const double* velI = nborAux + I * numAuxF + velOffset;
+            p.adv[0] += bf[I] * velI[0];
+            p.adv[1] += bf[I] * velI[1];
+            p.divVel += Dbfdx(I, 0) * velI[0] + Dbfdx(I, 1) * velI[1];
+        }
+    }
+
+    // Assembles the residual and Jacobian of numDOFs transported species that share the mass, stiffness
+    // and advection operators and differ only in their diffusivity and local reaction terms.
+    //  R[f]           reaction term of field f at the Gauss point (enters the residual as bf(I)*R[f])
+    //  dR[f*numDOFs+g] derivative of R[f] with respect to field g
+    void FillMorphogenBlocks(const P1Point& p, int numDOFs, const double* u, const double* u0,
+                             const double* diff, const double* R, const double* dR, double* Ak, double* Bk)
+    {
+        double mass[P1*P1], stiff[P1*P1], adv[P1*P1];
+        for(int I = 0; I < P1; I++)
+            for(int J = 0; J < P1; J++) {
+                mass[I*P1+J] = p.bf[I] * p.bf[J];
+                stiff[I*P1+J] = p.dbfdx[I][0] * p.dbfdx[J][0] + p.dbfdx[I][1] * p.dbfdx[J][1];
+                adv[I*P1+J] = p.bf[I] * (p.bf[J] * p.divVel + p.adv[0] * p.dbfdx[J][0] + p.adv[1] * p.dbfdx[J][1]);
+            }
+
+        // Mass of the time derivative, lumped onto its row sums bf(I) on request
+        double timeMass[P1*P1];
+        for(int I = 0; I < P1; I++)
+            for(int J = 0; J < P1; J++)
+                timeMass[I*P1+J] = lumpedMass ? (I == J ? p.bf[I] : 0.0) : mass[I*P1+J];
+
+        for(int f = 0; f < numDOFs; f++) {
+            double uf[P1], uf0[P1];
+            double val{}, val0{};
+            for(int J = 0; J < P1; J++) {
+                uf[J] = u[J*numDOFs+f];
+                uf0[J] = u0[J*numDOFs+f];
+                val += p.bf[J] * uf[J];
+                val0 += p.bf[J] * uf0[J];
+            }
+
+            for(int I = 0; I < P1; I++) {
+                double opU{};
+                for(int J = 0; J < P1; J++)
+                    opU += (diff[f] * stiff[I*P1+J] + adv[I*P1+J]) * uf[J];
+                const double rate = lumpedMass ? (uf[I] - uf0[I]) / p.dt : (val - val0) / p.dt;
+                Bk[I*numDOFs+f] = p.jac * (p.bf[I] * (rate + R[f]) + opU);
+            }
+
+            for(int g = 0; g < numDOFs; g++) {
+                const double dRfg = dR[f*numDOFs+g];
+                for(int I = 0; I < P1; I++)
+                    for(int J = 0; J < P1; J++) {
+                        double& a = Ak[((I*numDOFs+f)*P1+J)*numDOFs+g];
+                        if(f == g)
+                            a = p.jac * (timeMass[I*P1+J] / p.dt + mass[I*P1+J] * dRfg + diff[f] * stiff[I*P1+J] + adv[I*P1+J]);
+                        else
+                            a = p.jac * mass[I*P1+J] * dRfg;
+                    }
+            }
+        }
+    }
+
+    // Activator-inhibitor kinetics of the (c, h) pair
+    void turingReaction(double cN1, double hN1, double rhoc, double rhoh, int numDOFs, double* R, double* dR)
+    {
+        for(int f = 0; f < numDOFs*numDOFs; f++)
+            dR[f] = 0.0;
+        for(int f = 0; f < numDOFs; f++)
+            R[f] = 0.0;
+
+        R[0] = -rhoc * (cN1 * cN1 / hN1 - cN1);
+        R[1] = -rhoh * (cN1 * cN1 - hN1);
+        dR[0*numDOFs+0] = -rhoc * (2.0 * cN1 / hN1 - 1.0);
+        dR[0*numDOFs+1] = rhoc * cN1 * cN1 / hN1 / hN1;
+        dR[1*numDOFs+0] = -rhoh * 2.0 * cN1;
+        dR[1*numDOFs+1] = rhoh;
+    }
+
+    // Replaces the consistent mass bf(I)*bf(J)/dt of the time derivative assembled by the generic kernels
+    // with its row sum bf(I)/dt
+    void lumpTimeDerivative(hiperlife::FillStructure& fillStr, hiperlife::SubFillStructure& subFill, double jac, double dt)
+    {
+        const int eNN = subFill.eNN;
+        const int numDOFs = subFill.numDOFs;
+        const double* bf = subFill.nborBFs();
+        const double* u = subFill.nborDOFs.data();
+        const double* u0 = subFill.nborDOFs0.data();
+        double* Ak = fillStr.Ak(0, 0).data();
+        double* Bk = fillStr.Bk(0).data();
+
+        for(int f = 0; f < numDOFs; f++) {
+            double val{}, val0{};
+            for(int J = 0; J < eNN; J++) {
+                val += bf[J] * u[J*numDOFs+f];
+                val0 += bf[J] * u0[J*numDOFs+f];
+            }
+            for(int I = 0; I < eNN; I++) {
+                Bk[I*numDOFs+f] += jac * bf[I] * ((u[I*numDOFs+f] - u0[I*numDOFs+f]) - (val - val0)) / dt;
+                for(int J = 0; J < eNN; J++)
+                    Ak[((I*numDOFs+f)*eNN+J)*numDOFs+f] += jac * ((I == J ? bf[I] : 0.0) - bf[I] * bf[J]) / dt;
+            }
+        }
+    }
+
+    // Diffusivity of a term assembled by the reaction fill, zero when it has its own integration
+    double fillDiffusivity(hiperlife::FillStructure& fillStr, Params::RealParameters diffusivity)
+    {
+        return splitDiffusion ? 0.0 : fillStr.getRealParameter(diffusivity);
+    }
+
+    void fillTuringP1(hiperlife::FillStructure& fillStr, const P1Point& p, const double* u, const double* u0, int numDOFs)
+    {
+        constexpr int maxDOFs = 2;
+        const double dc  = fillDiffusivity(fillStr, Params::dc);
+        const double dh  = fillDiffusivity(fillStr, Params::dh);
+        const double rhoc = fillStr.getRealParameter(Params::rhoc);
+        const double rhoh = fillStr.getRealParameter(Params::rhoh);
+
+        double cN1{}, hN1{};
+        for(int I = 0; I < P1; I++) {
+            cN1 += p.bf[I] * u[I*numDOFs+0];
+            hN1 += p.bf[I] * u[I*numDOFs+1];
+        }
+
+        double diff[maxDOFs] = {dc, dh};
+        double R[maxDOFs], dR[maxDOFs*maxDOFs];
+        turingReaction(cN1, hN1, rhoc, rhoh, numDOFs, R, dR);
+
+        FillMorphogenBlocks(p, numDOFs, u, u0, diff, R, dR, fillStr.Ak(0, 0).data(), fillStr.Bk(0).data());
+    }
+}
+
 
 void ReactionDiffusion(hiperlife::FillStructure &fillStr)
 {
@@ -38,8 +215,8 @@ void ReactionDiffusion(hiperlife::FillStructure &fillStr)
     wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
 
     const double dt  = fillStr.getRealParameter(Params::dt);
-    const double dc  = fillStr.getRealParameter(Params::dc);
-    const double dh  = fillStr.getRealParameter(Params::dh);
+    const double dc  = fillDiffusivity(fillStr, Params::dc);
+    const double dh  = fillDiffusivity(fillStr, Params::dh);
     const double rhoc = fillStr.getRealParameter(Params::rhoc);
     const double rhoh = fillStr.getRealParameter(Params::rhoh);
 
@@ -64,6 +241,9 @@ void ReactionDiffusion(hiperlife::FillStructure &fillStr)
                              + dh * Dbfdx(I, a) * Dbfdx(J, a)
                              + rhoh * bf(I) * bf(J) );
     Ak(I, 1, J, 0) = -(jac * rhoh * 2.0 * cN1 ) * bf(I) * bf(J);
+
+    if(lumpedMass)
+        lumpTimeDerivative(fillStr, subFill, jac, dt);
 }
 
 void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
@@ -88,6 +268,13 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
     tensor<double, 2> Dbfdx(eNN, pDim);
     GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
 
+    if(isP1Triangle(subFill) and numDOFs == 2) {
+        P1Point p;
+        loadP1Point(p, subFill, Dbfdx, jac, fillStr.getRealParameter(Params::dt), subFill.nborAuxF.data(), subFill.numAuxF, 0);
+        fillTuringP1(fillStr, p, subFill.nborDOFs.data(), subFill.nborDOFs0.data(), numDOFs);
+        return;
+    }
+
     using ttl::index::I, ttl::index::J, ttl::index::N;
     using ttl::index::a, ttl::index::b;
 
@@ -102,8 +289,8 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
     wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
 
     const double dt  = fillStr.getRealParameter(Params::dt);
-    const double dc  = fillStr.getRealParameter(Params::dc);
-    const double dh  = fillStr.getRealParameter(Params::dh);
+    const double dc  = fillDiffusivity(fillStr, Params::dc);
+    const double dh  = fillDiffusivity(fillStr, Params::dh);
     const double rhoc = fillStr.getRealParameter(Params::rhoc);
     const double rhoh = fillStr.getRealParameter(Params::rhoh);
 
@@ -111,8 +298,6 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
     const double cN1 = mg_tN1(0);
     const double hN = mg_tN(1);
     const double hN1 = mg_tN1(1);
-    const double mN = mg_tN(2);
-    const double mN1 = mg_tN1(2);
 
     Bk(I, 0) = jac*(bf(I) * (cN1 - cN) / dt 
                      + dc * dmgdx(a, 0) * Dbfdx(I, a)
@@ -123,9 +308,6 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
                      + dh * dmgdx(a, 1) * Dbfdx(I, a)
                      - rhoh * bf(I) *(cN1 * cN1 - hN1));
     Bk(I, 1) += jac * bf(I) * (hN1 * Dbfdx(N, a) * nborVel(N, a) + vel(a) * dmgdx(a, 1)) ;
-    
-    Bk(I, 2) = jac*(bf(I) * (mN1 - mN) / dt);
-    Bk(I,2) += jac * bf(I) * (mN1 * Dbfdx(N, a) * nborVel(N, a) + vel(a) * dmgdx(a, 2)) ;
 
     Ak(I, 0, J, 0) = jac * ( bf(I) * bf(J) / dt
                              + dc * Dbfdx(I, a) * Dbfdx(J, a)
@@ -139,9 +321,53 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr)
                              + rhoh * bf(I) * bf(J) );
     Ak(I, 1, J, 1) += jac * bf(I) * (bf(J) * Dbfdx(N, a) * nborVel(N, a) + vel(a) * Dbfdx(J, a)) ;
     Ak(I, 1, J, 0) = -(jac * rhoh * 2.0 * cN1 ) * bf(I) * bf(J);
-    
-    Ak(I, 2, J, 2) = jac * ( bf(I) * bf(J) / dt);
-    Ak(I, 2, J, 2) += jac * bf(I) * (bf(J) * Dbfdx(N, a) * nborVel(N, a) + vel(a) * Dbfdx(J, a)) ;
+
+    if(lumpedMass)
+        lumpTimeDerivative(fillStr, subFill, jac, dt);
+}
+
+
+// Diffusion of the (c, h) pair alone, for its own integration when Params::quadrature is "split". Its
+// integrand is constant on linear triangles, so a one point rule integrates it exactly.
+void MorphogenDiffusion(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["morphogens"];
+    int pDim = subFill.pDim;                         // dimension of the parametrized object
+
+    int numDOFs = subFill.numDOFs;
+    int eNN = subFill.eNN;
+
+    wrapper<double, 2> nborDOFs(subFill.nborDOFs.data(), eNN, numDOFs);
+
+    double jac{};
+    tensor<double, 2> Dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
+
+    using ttl::index::I, ttl::index::J, ttl::index::N;
+    using ttl::index::a, ttl::index::i;
+
+    tensor<double, 2> dmgdx = Dbfdx(N, a) * nborDOFs(N, i);
+
+    wrapper<double,4> Ak(fillStr.Ak(0, 0).data(), eNN, numDOFs, eNN, numDOFs);
+    wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
+
+    const double dc  = fillStr.getRealParameter(Params::dc);
+    const double dh  = fillStr.getRealParameter(Params::dh);
+
+    Bk(I, 0) = jac * dc * dmgdx(a, 0) * Dbfdx(I, a);
+    Bk(I, 1) = jac * dh * dmgdx(a, 1) * Dbfdx(I, a);
+
+    Ak(I, 0, J, 0) = jac * dc * Dbfdx(I, a) * Dbfdx(J, a);
+    Ak(I, 1, J, 1) = jac * dh * Dbfdx(I, a) * Dbfdx(J, a);
+    for(int K = 0; K < eNN; K++)
+        for(int L = 0; L < eNN; L++) {
+            Ak(K, 0, L, 1) = 0.0;
+            Ak(K, 1, L, 0) = 0.0;
+        }
 }
 
 void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
@@ -166,6 +392,20 @@ void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
     tensor<double, 2> Dbfdx(eNN, pDim);
     GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
 
+    if(isP1Triangle(subFill) and numDOFs == 2) {
+        const double dt = fillStr.getRealParameter(Params::dt);
+        P1Point p;
+        loadP1Point(p, subFill, Dbfdx, jac, dt, subFill.nborAuxF.data(), subFill.numAuxF, 0);
+
+        // The ALE correction only shifts the advecting velocity by the mesh velocity (uN1-uN)/dt
+        for(int I = 0; I < P1; I++) {
+            p.adv[0] -= p.bf[I] * (nborAux(I, 2) - nborAux(I, 4)) / dt;
+            p.adv[1] -= p.bf[I] * (nborAux(I, 3) - nborAux(I, 5)) / dt;
+        }
+        fillTuringP1(fillStr, p, subFill.nborDOFs.data(), subFill.nborDOFs0.data(), numDOFs);
+        return;
+    }
+
     using ttl::index::N, ttl::index::M;
     using ttl::index::I, ttl::index::J;
     using ttl::index::a, ttl::index::b, ttl::index::c, ttl::index::d;
@@ -186,8 +426,8 @@ void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
     wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
 
     const double dt  = fillStr.getRealParameter(Params::dt);
-    const double dc  = fillStr.getRealParameter(Params::dc);
-    const double dh  = fillStr.getRealParameter(Params::dh);
+    const double dc  = fillDiffusivity(fillStr, Params::dc);
+    const double dh  = fillDiffusivity(fillStr, Params::dh);
     const double rhoc = fillStr.getRealParameter(Params::rhoc);
     const double rhoh = fillStr.getRealParameter(Params::rhoh);
 
@@ -195,8 +435,6 @@ void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
     const double cN1 = mg_tN1(0);
     const double hN = mg_tN(1);
     const double hN1 = mg_tN1(1);
-    const double mN = mg_tN(2);
-    const double mN1 = mg_tN1(2);
 
     Bk(I, 0) = jac*(bf(I) * (cN1 - cN) / dt
                      + dc * dmgdx(a, 0) * Dbfdx(I, a)
@@ -210,10 +448,6 @@ void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
     Bk(I, 1) += jac * bf(I) * (hN1 * Dbfdx(N, a) * nborVel(N, a) + vel(a) * dmgdx(a, 1)) ;
     Bk(I, 1) -= jac / (dt) * bf(I) * (uN1(a) - uN(a)) * dmgdx(a, 1);
 
-    Bk(I, 2) = jac * (bf(I)*(mN1 - mN) / dt
-                     + bf(I)*(mN1*Dbfdx(N,a)*nborVel(N,a)+vel(a)*dmgdx(a,2)));
-    Bk(I, 2) -= jac / (dt) * bf(I) * (uN1(a) - uN(a)) * dmgdx(a, 2);
-
     Ak(I, 0, J, 0) = jac * ( bf(I) * bf(J) / dt
                              + dc * Dbfdx(I, a) * Dbfdx(J, a)
                              - rhoc * bf(I) * bf(J) * (2.0 * cN1 / hN1 - 1.0) );
@@ -230,11 +464,108 @@ void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr)
     Ak(I, 1, J, 1) += jac * bf(I) * (bf(J) * Dbfdx(N, a) * nborVel(N, a) + vel(a) * Dbfdx(J, a)) ;
     Ak(I, 1, J, 1) -= jac / (dt) * bf(I) * (uN1(a) - uN(a)) * Dbfdx(J,a) ;
 
-    Ak(I,2,J,2) = jac * (bf(I) *bf(J)/dt + bf(I) * (bf(J)*Dbfdx(N,a)*nborVel(N,a) + vel(a) * Dbfdx(J, a)));
-    Ak(I,2,J,2) -= jac/ (dt) *bf(I) * (uN1(a)-uN(a))* Dbfdx(J,a) ;
+    if(lumpedMass)
+        lumpTimeDerivative(fillStr, subFill, jac, dt);
+}
+
+void Transport(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["transport"];
+    int pDim = subFill.pDim;                         // dimension of the parametrized object
+    int eNN = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+    wrapper<double,2> nborDOFs0(subFill.nborDOFs0.data(), eNN, 1);
+    wrapper<double,2> nborAux(subFill.nborAuxF.data(), eNN, subFill.numAuxF);
+
+    double jac{};
+    tensor<double, 2> Dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
+
+    using ttl::index::I, ttl::index::J, ttl::index::N;
+    using ttl::index::a;
+
+    tensor<double,2> nborVel = nborAux(ttl::all, ttl::range(0,1));
+    tensor<double,1> vel = nborVel(N, a) * bf(N);
+    const double divVel = Dbfdx(N, a) * nborVel(N, a);
+    const double mN = bf(N) * nborDOFs0(N, 0);
+
+    const double dt = fillStr.getRealParameter(Params::dt);
+
+    wrapper<double,2> Ak(fillStr.Ak(0, 0).data(), eNN, eNN);
+    wrapper<double,1> Bk(fillStr.Bk(0).data(), eNN);
+
+    // Linear in m: the operator is assembled directly and the right hand side carries the previous step
+    Ak(I, J) = jac * bf(I) * (bf(J) / dt + bf(J) * divVel + vel(a) * Dbfdx(J, a));
+    Bk(I) = jac * bf(I) * mN / dt;
+}
+
+void TransportALE(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["transport"];
+    int pDim = subFill.pDim;                         // dimension of the parametrized object
+    int eNN = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+    wrapper<double,2> nborDOFs0(subFill.nborDOFs0.data(), eNN, 1);
+    wrapper<double,2> nborAux(subFill.nborAuxF.data(), eNN, subFill.numAuxF);
+
+    double jac{};
+    tensor<double, 2> Dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
+
+    using ttl::index::I, ttl::index::J, ttl::index::N;
+    using ttl::index::a;
+
+    tensor<double,2> nborVel = nborAux(ttl::all, ttl::range(0,1));
+    tensor<double,2> nborUN1 = nborAux(ttl::all, ttl::range(2,3));
+    tensor<double,2> nborUN  = nborAux(ttl::all, ttl::range(4,5));
+    tensor<double,1> vel = nborVel(N, a) * bf(N);
+    tensor<double,1> uN1 = nborUN1(N, a) * bf(N);
+    tensor<double,1> uN = nborUN(N, a) * bf(N);
+    const double divVel = Dbfdx(N, a) * nborVel(N, a);
+    const double mN = bf(N) * nborDOFs0(N, 0);
+
+    const double dt = fillStr.getRealParameter(Params::dt);
+
+    wrapper<double,2> Ak(fillStr.Ak(0, 0).data(), eNN, eNN);
+    wrapper<double,1> Bk(fillStr.Bk(0).data(), eNN);
+
+    tensor<double,1> advVel = vel(a) - (uN1(a) - uN(a)) / dt;
+    Ak(I, J) = jac * bf(I) * (bf(J) / dt + bf(J) * divVel + advVel(a) * Dbfdx(J, a));
+    Bk(I) = jac * bf(I) * mN / dt;
+}
+
+void TransportIntegrals(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["transport"];
+    int pDim = subFill.pDim;                         // dimension of the parametrized object
+    int eNN = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+    wrapper<double,2> nborDOFs(subFill.nborDOFs.data(), eNN, 1);
+
+    double jac{};
+    tensor<double, 2> Dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
+
+    using ttl::index::N;
+    const double m = bf(N) * nborDOFs(N, 0);
 
     fillStr.addToGlobalIntegral("area", jac);
-    fillStr.addToGlobalIntegral("mass", jac * mN1);
+    fillStr.addToGlobalIntegral("mass", jac * m);
     // add integration of the mass derivative, should be zero
 }
 
@@ -282,6 +613,13 @@ void TensionFlow(hiperlife::FillStructure &fillStr)
 }
 
 double CheckCFL(hiperlife::SmartPtr<hiperlife::DOFsHandler>& velocity)
+{
+    CFLReduction cfl;
+    StartCFL(velocity, cfl);
+    return FinishCFL(cfl);
+}
+
+void StartCFL(hiperlife::SmartPtr<hiperlife::DOFsHandler>& velocity, CFLReduction& cfl)
 {
     using namespace hiperlife;
     using std::vector;
@@ -330,10 +668,85 @@ double CheckCFL(hiperlife::SmartPtr<hiperlife::DOFsHandler>& velocity)
             minDeltaT = minElemDeltaT;
     }
 
-    double recDeltaT{};
-    MPI_Allreduce(&minDeltaT, &recDeltaT, 1, MPI_DOUBLE, MPI_MIN, velocity->comm());
+    cfl.local = minDeltaT;
+    MPI_Iallreduce(&cfl.local, &cfl.global, 1, MPI_DOUBLE, MPI_MIN, velocity->comm(), &cfl.request);
+}
+
+double FinishCFL(CFLReduction& cfl)
+{
+    MPI_Wait(&cfl.request, MPI_STATUS_IGNORE);
+    return 0.1*cfl.global;
+}
+
+double FieldChange(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld)
+{
+    using namespace hiperlife;
+
+    double local[2]{};
+    for(int i = 0; i < field->mesh->loc_nPts(); i++) {
+        const double delta = field->nodeDOFs->getValue(fld, i, IndexType::Local) - field->nodeDOFs0->getValue(fld, i, IndexType::Local);
+        local[0] += delta * delta;
+    }
+    local[1] = field->mesh->loc_nPts();
+
+    double global[2]{};
+    MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_SUM, field->comm());
 
-    return 0.1*recDeltaT;
+    return sqrt(global[0] / global[1]);
+}
+
+double FieldMean(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld)
+{
+    using namespace hiperlife;
+
+    double local[2]{};
+    for(int i = 0; i < field->mesh->loc_nPts(); i++)
+        local[0] += field->nodeDOFs->getValue(fld, i, IndexType::Local);
+    local[1] = field->mesh->loc_nPts();
+
+    double global[2]{};
+    MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_SUM, field->comm());
+
+    return global[0] / global[1];
+}
+
+double DiffusionSpectralRadius(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, double diffusivity)
+{
+    using namespace hiperlife;
+    using std::vector;
+
+    DistributedMesh& mesh = *field->mesh;
+
+    // The Rayleigh quotient of (K, M_lumped) is bounded by its largest element-wise value, and for a linear
+    // triangle λmax(K_e) <= trace(K_e) = area * sum_I |∇φ_I|^2 with |∇φ_I| = |e_I| / (2 area).
+    double maxRadius{};
+    for(int e = 0; e < mesh.loc_nElem(); e++)
+    {
+        // FIXME Only valid for linear triangles
+        vector<double> elemCoords = mesh.elemNborNodeCoords(e, IndexType::Local);
+        double edge[3][3];
+        for(int i = 0; i < 3; i++)
+            for(int d = 0; d < 3; d++)
+                edge[i][d] = elemCoords[3*((i+2)%3)+d] - elemCoords[3*((i+1)%3)+d];
+
+        const double cross[3] = {edge[0][1]*edge[1][2] - edge[0][2]*edge[1][1],
+                                 edge[0][2]*edge[1][0] - edge[0][0]*edge[1][2],
+                                 edge[0][0]*edge[1][1] - edge[0][1]*edge[1][0]};
+        const double area = 0.5 * sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]);
+
+        double sumEdges2{};
+        for(int i = 0; i < 3; i++)
+            sumEdges2 += edge[i][0]*edge[i][0] + edge[i][1]*edge[i][1] + edge[i][2]*edge[i][2];
+
+        const double elemRadius = 3.0 * sumEdges2 / (4.0 * area * area);
+        if(elemRadius > maxRadius)
+            maxRadius = elemRadius;
+    }
+
+    double radius{};
+    MPI_Allreduce(&maxRadius, &radius, 1, MPI_DOUBLE, MPI_MAX, field->comm());
+
+    return diffusivity * radius;
 }
 
 void ReactionDiffusionGrayScott(hiperlife::FillStructure &fillStr)
@@ -388,6 +801,114 @@ void ReactionDiffusionGrayScott(hiperlife::FillStructure &fillStr)
     Ak(I, 1, J, 0) = jac * (- β1*β1 * bf(I) * bf(J));
 }
 
+void ReactionDiffusionExplicit(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["morphogens"];
+    int pDim = subFill.pDim;                         // dimension of the parametrized object
+
+    int numDOFs = subFill.numDOFs;
+    int eNN  = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+    wrapper<double,2> nborDOFs(subFill.nborDOFs.data(), eNN, numDOFs);
+
+    double jac{};
+    tensor<double, 2> Dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(Dbfdx, jac, subFill);
+
+    using ttl::index::I, ttl::index::N;
+    using ttl::index::a, ttl::index::i;
+
+    tensor<double,1> mg = nborDOFs(N, a) * bf(N);
+    tensor<double,2> dmgdx = Dbfdx(N, a) * nborDOFs(N, i);
+
+    wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
+
+    const double dc  = fillStr.getRealParameter(Params::dc);
+    const double dh  = fillStr.getRealParameter(Params::dh);
+    const double rhoc = fillStr.getRealParameter(Params::rhoc);
+    const double rhoh = fillStr.getRealParameter(Params::rhoh);
+
+    const double c = mg(0);
+    const double h = mg(1);
+
+    // Explicit right hand side only, the Jacobian blocks stay empty. The driver divides the assembled vector
+    // by the lumped mass of MorphogenLumpedMass to get du/dt.
+
+    Bk(I, 0) = -jac * (dc * dmgdx(a, 0) * Dbfdx(I, a) - rhoc * bf(I) * (c * c / h - c));
+    Bk(I, 1) = -jac * (dh * dmgdx(a, 1) * Dbfdx(I, a) - rhoh * bf(I) * (c * c - h));
+}
+
+void ReactionDiffusionGrayScottExplicit(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["morphogens"];
+    int pDim = subFill.pDim;                         // dimension of the parametrizied object
+
+    int numDOFs = subFill.numDOFs;
+    int eNN  = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+    wrapper<double,2> nborDOFs(subFill.nborDOFs.data(), eNN, numDOFs);
+
+    double jac{};
+    tensor<double, 2> dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(dbfdx, jac, subFill);
+
+    using ttl::index::I, ttl::index::N;
+    using ttl::index::a, ttl::index::i;
+
+    tensor<double,1> c1 = nborDOFs(N,a) * bf(N);
+    tensor<double,2> dcdx = dbfdx(N,a) * nborDOFs(N,i);
+
+    wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
+
+    const double dα  = fillStr.getRealParameter(Params::dA);
+    const double dβ  = fillStr.getRealParameter(Params::dB);
+    const double f = fillStr.getRealParameter(Params::f);
+    const double k = fillStr.getRealParameter(Params::k);
+
+    const double α1 = c1(0);
+    const double β1 = c1(1);
+
+    // Explicit right hand side only, see ReactionDiffusionExplicit
+
+    Bk(I, 0) = -jac * (dα * dcdx(a, 0) * dbfdx(I, a) + bf(I) * α1 * β1 * β1 - bf(I) * f * (1.0 - α1));
+    Bk(I, 1) = -jac * (dβ * dcdx(a, 1) * dbfdx(I, a) - bf(I) * α1 * β1 * β1 + bf(I) * (f + k) * β1);
+}
+
+void MorphogenLumpedMass(hiperlife::FillStructure &fillStr)
+{
+    using ttl::tensor;
+    using ttl::wrapper;
+    using namespace hiperlife;
+
+    SubFillStructure& subFill = fillStr["morphogens"];
+    int pDim = subFill.pDim;
+
+    int numDOFs = subFill.numDOFs;
+    int eNN  = subFill.eNN;
+
+    wrapper<double,1> bf(subFill.nborBFs(), eNN);
+
+    double jac{};
+    tensor<double, 2> dbfdx(eNN, pDim);
+    GlobalBasisFunctions::gradients(dbfdx, jac, subFill);
+
+    // Row sums of the mass matrix, the same for every field
+    wrapper<double,2> Bk(fillStr.Bk(0).data(), eNN, numDOFs);
+    for(int n = 0; n < eNN; n++)
+        for(int f = 0; f < numDOFs; f++)
+            Bk(n, f) = jac * bf(n);
+}
+
 void ALEBulk(hiperlife::FillStructure &fillStr)
 {
     using ttl::tensor;
@@ -507,13 +1028,18 @@ void ALEBoundary(hiperlife::FillStructure &fillStr)
 
 }
 
-void DeformMesh(const hiperlife::SmartPtr<hiperlife::LinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation)
+void DeformMesh(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation,
+                GhostExchange& ghosts)
 {
     using namespace hiperlife;
 
+    // ALEBoundary reads the ghosts of nodeDOFs0 and of the vx, vy aux fields, which the flow solve has
+    // just updated. Both go in the same round of messages.
     deformation->nodeDOFs0->setValue(deformation->nodeDOFs);
-    deformation->UpdateGhosts();
-    linSolver->solve();
+    ghosts.markDirty(deformation->nodeDOFs0);
+    ghosts.markDirty(deformation->nodeAuxF);
+    ghosts.flush();
+    SolveWithFallback(linSolver);
     linSolver->UpdateSolution();
 
     if(!linSolver->converged()) {
@@ -544,6 +1070,78 @@ void DeformMesh(const hiperlife::SmartPtr<hiperlife::LinearSolver>& linSolver, c
         deformation->nodeAuxF->setValue("errUy", i, IndexType::Local, errUy/norm);
 
     }
+    // nodeDOFs0 has not changed since the solve. The rest, including the errUx, errUy aux fields written
+    // above, is exchanged at the caller's next flush
+    ghosts.markDirty(deformation->mesh->_nodeData);
+    ghosts.markDirty(deformation->nodeDOFs);
+    ghosts.markDirty(deformation->nodeAuxF);
+}
+
+void ResetMesh(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation)
+{
+    using namespace hiperlife;
+
+    for(int i = 0; i < deformation->mesh->loc_nPts(); i++) {
+        deformation->mesh->_nodeData->setValue(0, i, IndexType::Local, deformation->nodeAuxF->getValue("x0", i, IndexType::Local));
+        deformation->mesh->_nodeData->setValue(1, i, IndexType::Local, deformation->nodeAuxF->getValue("y0", i, IndexType::Local));
+    }
+    deformation->setInitialCondition(0, 0.0);
+    deformation->setInitialCondition(1, 0.0);
+    deformation->nodeDOFs0->setValue(deformation->nodeDOFs);
+
     deformation->mesh->_nodeData->UpdateGhosts();
     deformation->UpdateGhosts();
 }
+
+void SetFactorization(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr)
+{
+    if(paramStr->getStringParameter(Params::factorization) == "double")
+        return;
+
+    linSolver->setICNTL(35, 2);                      // block-low-rank factorization and solution
+    linSolver->setCNTL(7, paramStr->getRealParameter(Params::blrtol));  // low-rank dropping tolerance
+
+    // Iterative refinement in double precision stops once the componentwise backward error of the
+    // residual falls below CNTL(2), so the compressed factors do not loosen the solver tolerance.
+    linSolver->setICNTL(10, static_cast<int>(paramStr->getRealParameter(Params::refinement)));
+    linSolver->setICNTL(11, 2);                      // backward error of the refined residual
+
+    blrSolvers[linSolver.get()] = paramStr->getRealParameter(Params::berrtol);
+}
+
+bool CheckFactorization(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver)
+{
+    const auto blr = blrSolvers.find(linSolver.get());
+    if(blr == blrSolvers.end())
+        return true;
+
+    // RINFOG(7) and RINFOG(8) are the componentwise backward errors omega1 and omega2 after refinement,
+    // the same on every rank
+    const double backwardError = linSolver->RINFOG(7) + linSolver->RINFOG(8);
+    if(backwardError <= blr->second)
+        return true;
+
+    int rank{};
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(rank == 0)
+        std::cerr << "Warning: backward error " << backwardError << " of the block-low-rank solve is above "
+                  << blr->second << ", switching the solver to a full precision factorization" << std::endl;
+
+    linSolver->setICNTL(35, 0);
+    linSolver->Update();
+    blrSolvers.erase(blr);
+    return false;
+}
+
+void SolveWithFallback(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver)
+{
+    linSolver->solve();
+    if(!CheckFactorization(linSolver))
+        linSolver->solve();
+}
+
+void SetAssemblyOptions(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr)
+{
+    lumpedMass = paramStr->getStringParameter(Params::massmatrix) == "lumped";
+    splitDiffusion = paramStr->getStringParameter(Params::quadrature) == "split";
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <hl_LinearSolver.h>
+#include <hl_LinearSolver_Direct_MUMPS.h>
+#include <hl_ParamStructure.h>
+
+class GhostExchange;
 
 struct Params
 {
@@ -23,7 +27,26 @@ struct Params
         lame1,
         lame2,
         kp,
-        f
+        f,
+        seed,
+        steadytol,
+        ptcgrowth,
+        dtsteady,
+        analysisevery,
+        analysisbins,
+        outputevery,
+        meshsize,
+        blrtol,
+        refinement,
+        consistencyrate,
+        consistencyevery,
+        quadorder,
+        nsteps,
+        nelem,
+        rkctol,
+        berrtol,
+        consistencydelta,
+        consistencytol
     };
 
     enum StringParameters
@@ -31,7 +54,13 @@ struct Params
         filemesh,
         mumpsanalysis,
         consistency,
-        prefix
+        prefix,
+        ensemble,
+        model,
+        meshcache,
+        factorization,
+        massmatrix,
+        quadrature
     };
 
     HL_PARAMETER_LIST DefaultValues{
@@ -50,10 +79,38 @@ struct Params
             {"lame1",1.0},
             {"lame2",0.1},
             {"kp",1.E3},
+            {"dA",2.E-5},
+            {"dB",1.E-5},
+            {"f",0.04},
+            {"seed",1.0},
+            {"steadytol",0.0},
+            {"ptcgrowth",2.0},
+            {"dtsteady",1.E4},
+            {"analysisevery",10.0},
+            {"analysisbins",256.0},
+            {"outputevery",1.0},
+            {"meshsize",0.002},
+            {"blrtol",1.E-8},
+            {"refinement",10.0},
+            {"consistencyrate",0.01},
+            {"consistencyevery",10.0},
+            {"quadorder",3.0},
+            {"nsteps",0.0},
+            {"nelem",0.0},
+            {"rkctol",1.E-4},
+            {"berrtol",1.E-10},
+            {"consistencydelta",1.E-6},
+            {"consistencytol",1.E-4},
             {"filemesh",""},
             {"prefix", "field"},
+            {"ensemble", ""},
+            {"meshcache", ""},
             {"mumpsanalysis","parallel", {"sequential","parallel"}},
-            {"consistency","none",{"none","hessian"}}
+            {"consistency","none",{"none","full","hessian","sampled"}},
+            {"model","reactiondiffusion",{"reactiondiffusion","grayscott"}},
+            {"factorization","double",{"double","blr"}},
+            {"massmatrix","consistent",{"consistent","lumped"}},
+            {"quadrature","uniform",{"uniform","split"}}
     };
 };
 
@@ -63,16 +120,71 @@ void ConvectionDiffusion(hiperlife::FillStructure &fillStr);
 
 void ConvectionDiffusionALE(hiperlife::FillStructure &fillStr);
 
+void MorphogenDiffusion(hiperlife::FillStructure &fillStr);
+
+void Transport(hiperlife::FillStructure &fillStr);
+
+void TransportALE(hiperlife::FillStructure &fillStr);
+
+// Area and mass of m on the current mesh, as global integrals. Assembles nothing.
+void TransportIntegrals(hiperlife::FillStructure &fillStr);
+
 void TensionFlow(hiperlife::FillStructure &fillStr);
 
 double CheckCFL(hiperlife::SmartPtr<hiperlife::DOFsHandler>& velocity);
 
+// CheckCFL split around a non-blocking reduction, so that independent work can run while it completes
+struct CFLReduction
+{
+    double local;
+    double global;
+    MPI_Request request;
+};
+
+void StartCFL(hiperlife::SmartPtr<hiperlife::DOFsHandler>& velocity, CFLReduction& cfl);
+
+double FinishCFL(CFLReduction& cfl);
+
+// Root mean square nodal change of field fld between nodeDOFs0 and nodeDOFs over all ranks
+double FieldChange(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld);
+
+// Mean nodal value of field fld over all ranks
+double FieldMean(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, int fld);
+
 void ReactionDiffusionGrayScott(hiperlife::FillStructure &fillStr);
 
+void ReactionDiffusionExplicit(hiperlife::FillStructure &fillStr);
+
+void ReactionDiffusionGrayScottExplicit(hiperlife::FillStructure &fillStr);
+
+// Lumped mass of the morphogens assembled as a right hand side, for the explicit kernels above
+void MorphogenLumpedMass(hiperlife::FillStructure &fillStr);
+
+double DiffusionSpectralRadius(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& field, double diffusivity);
+
 void ALEBulk(hiperlife::FillStructure &fillStrr);
 
 void ALEBoundary(hiperlife::FillStructure &fillStr);
 
-void DeformMesh(const Teuchos::RCP<hiperlife::LinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation);
+// Moves the mesh by the displacement increment. The ghost updates of the coordinates, displacement and
+// aux fields are left pending in ghosts.
+void DeformMesh(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation,
+                GhostExchange& ghosts);
+
+// Sets the factorization mode of Params::factorization on a MUMPS solver, before its Update
+void SetFactorization(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver, const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr);
+
+// Reads the backward error of the last solve of a solver set to block-low-rank by SetFactorization. Above
+// Params::berrtol the solver falls back to a full precision factorization and false is returned, so that
+// the caller solves again. Always true for full precision solvers. After a Newton solve the result can be
+// ignored: a rejected factorization only slows Newton down, and the next iterations use full precision.
+bool CheckFactorization(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver);
+
+// Solves, and solves again in full precision when CheckFactorization rejects the block-low-rank solution
+void SolveWithFallback(const hiperlife::SmartPtr<hiperlife::MUMPSDirectLinearSolver>& linSolver);
 
+// Lumping of the time derivative (Params::massmatrix) and the split of diffusion into its own integration
+// (Params::quadrature)
+void SetAssemblyOptions(const hiperlife::SmartPtr<hiperlife::ParamStructure>& paramStr);
 
+void ResetMesh(const hiperlife::SmartPtr<hiperlife::DOFsHandler>& deformation);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Counter-based Philox4x32-10 generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11).
+// Every draw is a pure function of a counter and a key, so values attached to mesh nodes can be generated
+// independently on each rank and do not depend on the order in which nodes are visited.
+class Philox4x32
+{
+public:
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    static Counter generate(Counter ctr, Key key)
+    {
+        for(int round = 0; round < 10; round++) {
+            if(round > 0) {
+                key[0] += 0x9E3779B9u;
+                key[1] += 0xBB67AE85u;
+            }
+            const uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+            const uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+            ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1),
+                   uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0)};
+        }
+        return ctr;
+    }
+};
+
+// Uniform number in [0,1) attached to the point (x, y). The counter is built from the bit patterns of the
+// coordinates, which are the same on every rank whatever the partition, and the key from the seed and a
+// stream index that separates the fields drawn at the same node.
+inline double UniformAtPoint(double x, double y, uint32_t seed, uint32_t stream)
+{
+    // Adding 0.0 folds -0.0 into +0.0
+    x += 0.0;
+    y += 0.0;
+    uint64_t xBits, yBits;
+    std::memcpy(&xBits, &x, sizeof(double));
+    std::memcpy(&yBits, &y, sizeof(double));
+
+    const Philox4x32::Counter r = Philox4x32::generate(
+            {uint32_t(xBits), uint32_t(xBits >> 32), uint32_t(yBits), uint32_t(yBits >> 32)}, {seed, stream});
+
+    // 53 random bits mapped to [0,1)
+    const uint64_t bits = (uint64_t(r[0]) << 21) ^ (uint64_t(r[1]) >> 11);
+    return double(bits & ((uint64_t(1) << 53) - 1)) * 0x1.0p-53;
+}
+
+// Seed given as a real parameter. Converting a negative, fractional or too large double to uint32_t is
+// undefined, so those values are rejected before going through int64_t.
+inline uint32_t SeedFromParameter(double value)
+{
+    if(!(value >= 0.0 and value <= 4294967295.0) or value != std::floor(value)) {
+        std::cerr << "Invalid seed " << value << ". It must be an integer in [0, 4294967295]" << std::endl;
+        abort();
+    }
+    return static_cast<uint32_t>(static_cast<int64_t>(value));
+}
@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cmath>
+#include <mpi.h>
+#include <vector>
+
+#include <hl_MeshLoader.h>
+#include <hl_NonlinearSolver_NewtonRaphson.h>
+#include <hl_LinearSolver_Direct_MUMPS.h>
+#include "hl_DistributedClass.h"
+#include "hl_HiPerProblem.h"
+#include "hl_StructMeshGenerator.h"
+#include "hl_ParamStructure.h"
+#include "hl_Parser.h"
+
+#include "Physics.h"
+#include "PatternAnalysis.h"
+#include "Random.h"
+#include "RunSummary.h"
+
+// Coefficients of the damped second order Runge-Kutta-Chebyshev method (Sommeijer, Shampine & Verwer, 1997).
+// Stage j of a step of size tau reads
+//     Y_j = (1 - mu_j - nu_j) Y_0 + mu_j Y_{j-1} + nu_j Y_{j-2} + muT_j tau F(Y_{j-1}) + gammaT_j tau F(Y_0)
+struct RKCCoefficients
+{
+    std::vector<double> mu, nu, muT, gammaT;
+
+    explicit RKCCoefficients(int s)
+        : mu(s + 1), nu(s + 1), muT(s + 1), gammaT(s + 1)
+    {
+        const double eps = 2.0 / 13.0;
+        const double w0 = 1.0 + eps / (s * s);
+
+        // Chebyshev polynomials and their first two derivatives at w0
+        std::vector<double> T(s + 1), dT(s + 1), d2T(s + 1);
+        T[0] = 1.0; dT[0] = 0.0; d2T[0] = 0.0;
+        T[1] = w0;  dT[1] = 1.0; d2T[1] = 0.0;
+        for(int j = 2; j <= s; j++) {
+            T[j] = 2.0 * w0 * T[j-1] - T[j-2];
+            dT[j] = 2.0 * T[j-1] + 2.0 * w0 * dT[j-1] - dT[j-2];
+            d2T[j] = 4.0 * dT[j-1] + 2.0 * w0 * d2T[j-1] - d2T[j-2];
+        }
+        const double w1 = dT[s] / d2T[s];
+
+        std::vector<double> b(s + 1);
+        for(int j = 2; j <= s; j++)
+            b[j] = d2T[j] / (dT[j] * dT[j]);
+        b[0] = b[1] = b[2];
+
+        muT[1] = b[1] * w1;
+        for(int j = 2; j <= s; j++) {
+            mu[j] = 2.0 * b[j] * w0 / b[j-1];
+            nu[j] = -b[j] / b[j-2];
+            muT[j] = 2.0 * b[j] * w1 / b[j-1];
+            gammaT[j] = -(1.0 - b[j-1] * T[j-1]) * muT[j];
+        }
+    }
+
+    // Smallest number of stages whose real stability interval, about 0.653 s^2, covers tau * rho
+    static int numStages(double tau, double rho)
+    {
+        return std::max(2, 1 + static_cast<int>(std::sqrt(1.54 * tau * rho + 1.0)));
+    }
+};
+
+int main(int argc, char** argv) {
+    using std::cout, std::cerr, std::vector;
+    using namespace hiperlife;
+
+    hiperlife::Init(argc, argv);
+
+    SmartPtr<ParamStructure> paramStr = ReadParamsFromCommandLine<Params>();
+    SetAssemblyOptions(paramStr);
+
+    SaveParamsToConfigFile(paramStr, paramStr->getStringParameter(Params::prefix) + "_config.txt");
+
+    const bool grayScott = paramStr->getStringParameter(Params::model) == "grayscott";
+
+    const double domainLength = 2.0;
+    SmartPtr<MeshCreator> meshCreator;
+    if(paramStr->getStringParameter(Params::filemesh) == "") {
+        SmartPtr<StructMeshGenerator> meshGen = Create<StructMeshGenerator>();
+        meshGen->setMesh(ElemType::Triang, BasisFuncType::Lagrangian, 1);
+        meshGen->setPeriodicBoundaryCondition({Axis::Xaxis, Axis::Yaxis});
+        meshGen->genSquare(paramStr->getRealParameter(Params::nelem) > 0.0 ? static_cast<int>(paramStr->getRealParameter(Params::nelem)) : 200, domainLength);
+        meshCreator = meshGen;
+    }
+    else {
+        SmartPtr<MeshLoader> meshLoader = Create<MeshLoader>();
+        meshLoader->setMesh(ElemType::Triang, BasisFuncType::Linear, 1);
+        meshLoader->loadVtk(paramStr->getStringParameter(Params::filemesh), MeshType::Parallel);
+        meshCreator = meshLoader;
+    }
+
+    SmartPtr<DistributedMesh> mesh = Create<DistributedMesh>();
+    mesh->setMesh(meshCreator);
+    mesh->setBalanceMesh(true);
+    mesh->Update();
+
+    SmartPtr<DOFsHandler> fieldMorphogens = Create<DOFsHandler>(mesh);
+    fieldMorphogens->setNameTag("morphogens");
+    fieldMorphogens->setDOFs({"c", "h"});
+    fieldMorphogens->Update();
+
+    SmartPtr<HiPerProblem> problem = Create<HiPerProblem>();
+    problem->setParameterStructure(paramStr);
+    problem->setDOFsHandlers({fieldMorphogens});
+    problem->setIntegration("IntegMorphogens", {"morphogens"});
+    problem->setCubatureGauss("IntegMorphogens", static_cast<int>(paramStr->getRealParameter(Params::quadorder)));
+    if(grayScott)
+        problem->setElementFillings("IntegMorphogens", ReactionDiffusionGrayScottExplicit);
+    else
+        problem->setElementFillings("IntegMorphogens", ReactionDiffusionExplicit);
+    problem->Update();
+
+    const uint32_t seed = SeedFromParameter(paramStr->getRealParameter(Params::seed));
+    if(grayScott) {
+        // Trivial state u = 1, v = 0 with a perturbed patch in the middle of the domain
+        fieldMorphogens->setInitialCondition("c", [seed](double x, double y) {
+            return (std::abs(x - 1.0) < 0.1 and std::abs(y - 1.0) < 0.1 ? 0.5 : 1.0) + 0.01 * UniformAtPoint(x, y, seed, 0);
+        });
+        fieldMorphogens->setInitialCondition("h", [seed](double x, double y) {
+            return (std::abs(x - 1.0) < 0.1 and std::abs(y - 1.0) < 0.1 ? 0.25 : 0.0) + 0.01 * UniformAtPoint(x, y, seed, 1);
+        });
+    }
+    else {
+        fieldMorphogens->setInitialCondition("c", [seed](double x, double y) {
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 0) - 1.0);
+        });
+        fieldMorphogens->setInitialCondition("h", [seed](double x, double y) {
+            return 1.0 + 0.01 * (2.0 * UniformAtPoint(x, y, seed, 1) - 1.0);
+        });
+    }
+    fieldMorphogens->UpdateGhosts();
+    fieldMorphogens->printFileVtk(paramStr->getStringParameter(Params::prefix) + "_morphogens_0", true);
+
+    // Diffusion sets the stiffness; the reaction rates are added as a margin on the spectral radius
+    const double maxDiffusivity = grayScott ? std::max(paramStr->getRealParameter(Params::dA), paramStr->getRealParameter(Params::dB))
+                                            : std::max(paramStr->getRealParameter(Params::dc), paramStr->getRealParameter(Params::dh));
+    const double reactionRate = grayScott ? 1.0 + paramStr->getRealParameter(Params::f) + paramStr->getRealParameter(Params::k)
+                                          : 2.0 * std::max(paramStr->getRealParameter(Params::rhoc), paramStr->getRealParameter(Params::rhoh));
+    const double rho = 1.2 * DiffusionSpectralRadius(fieldMorphogens, maxDiffusivity) + reactionRate;
+
+    const int numDOFs = 2;
+    const int nPts = mesh->loc_nPts();
+    const int size = numDOFs * nPts;
+
+    auto getState = [&](vector<double>& y) {
+        for(int i = 0; i < nPts; i++)
+            for(int f = 0; f < numDOFs; f++)
+                y[numDOFs*i+f] = fieldMorphogens->nodeDOFs->getValue(f, i, IndexType::Local);
+    };
+    auto setState = [&](const vector<double>& y) {
+        for(int i = 0; i < nPts; i++)
+            for(int f = 0; f < numDOFs; f++)
+                fieldMorphogens->nodeDOFs->setValue(f, i, IndexType::Local, y[numDOFs*i+f]);
+        fieldMorphogens->UpdateGhosts();
+    };
+
+    // The lumped mass is assembled once as a right hand side and kept as a vector; its own problem is
+    // released afterwards.
+    vector<double> lumpedMass(size);
+    {
+        SmartPtr<HiPerProblem> problemMass = Create<HiPerProblem>();
+        problemMass->setParameterStructure(paramStr);
+        problemMass->setDOFsHandlers({fieldMorphogens});
+        problemMass->setIntegration("IntegMass", {"morphogens"});
+        problemMass->setCubatureGauss("IntegMass", static_cast<int>(paramStr->getRealParameter(Params::quadorder)));
+        problemMass->setElementFillings("IntegMass", MorphogenLumpedMass);
+        problemMass->Update();
+        problemMass->FillLinearSystem();
+        for(int i = 0; i < nPts; i++)
+            for(int f = 0; f < numDOFs; f++)
+                lumpedMass[numDOFs*i+f] = problemMass->rhs()->getValue(f, i, IndexType::Local);
+    }
+
+    // The rates read the assembled vector through rhs() and take it to hold Bk as the kernels write it. A sign
+    // convention of rhs() would cancel between F and the lumped mass, which are read the same way, but a
+    // flipped F alone would run the model backwards in time. One backward Euler step of the implicit kernel
+    // at a small dt has to move the state the same way as the explicit rate: with dy_e = dt M_l^{-1} F and
+    // dy_i = dt M^{-1} F for the implicit mass M,
+    //     dy_e . M_l dy_i = dt^2 F^T M^{-1} F > 0
+    {
+        vector<double> y0(size), y1(size);
+        getState(y0);
+        problem->FillLinearSystem();
+
+        SmartPtr<HiPerProblem> problemCheck = Create<HiPerProblem>();
+        problemCheck->setParameterStructure(paramStr);
+        problemCheck->setDOFsHandlers({fieldMorphogens});
+        problemCheck->setIntegration("IntegMorphogens", {"morphogens"});
+        problemCheck->setCubatureGauss("IntegMorphogens", static_cast<int>(paramStr->getRealParameter(Params::quadorder)));
+        if(grayScott)
+            problemCheck->setElementFillings("IntegMorphogens", ReactionDiffusionGrayScott);
+        else
+            problemCheck->setElementFillings("IntegMorphogens", ReactionDiffusion);
+        problemCheck->Update();
+
+        SmartPtr<MUMPSDirectLinearSolver> linSolCheck = Create<MUMPSDirectLinearSolver>();
+        linSolCheck->setHiPerProblem(problemCheck);
+        linSolCheck->setVerbosity(MUMPSDirectLinearSolver::Verbosity::None);
+        linSolCheck->setDefaultParameters();
+        linSolCheck->Update();
+
+        SmartPtr<NewtonRaphsonNonlinearSolver> nonLinSolCheck = Create<NewtonRaphsonNonlinearSolver>();
+        nonLinSolCheck->setLinearSolver(linSolCheck);
+        nonLinSolCheck->setMaxNumIterations(10);
+        nonLinSolCheck->setResTolerance(1.E-10);
+        nonLinSolCheck->setSolTolerance(1.E-10);
+        nonLinSolCheck->setLineSearch(false);
+        nonLinSolCheck->setConvRelTolerance(true);
+        nonLinSolCheck->setPrintIntermInfo(false);
+        nonLinSolCheck->setPrintSummary(false);
+        nonLinSolCheck->Update();
+
+        const double lastDt = paramStr->getRealParameter(Params::dt);
+        const double checkDt = 1.E-3 * lastDt;
+        paramStr->setRealParameter(Params::dt, checkDt);
+        fieldMorphogens->nodeDOFs0->setValue(fieldMorphogens->nodeDOFs);
+        nonLinSolCheck->solve();
+        const bool converged = nonLinSolCheck->converged();
+        getState(y1);
+        paramStr->setRealParameter(Params::dt, lastDt);
+
+        double local[3]{};
+        for(int i = 0; i < nPts; i++)
+            for(int f = 0; f < numDOFs; f++) {
+                const int n = numDOFs*i+f;
+                const double dyE = checkDt * problem->rhs()->getValue(f, i, IndexType::Local) / lumpedMass[n];
+                const double dyI = y1[n] - y0[n];
+                local[0] += dyE * lumpedMass[n] * dyI;
+                local[1] += dyE * lumpedMass[n] * dyE;
+                local[2] += dyI * lumpedMass[n] * dyI;
+            }
+        double global[3];
+        MPI_Allreduce(local, global, 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        setState(y0);
+
+        // Cosine of the two increments in the lumped mass inner product, 1 for identical directions
+        const double cosine = global[0] / std::sqrt(global[1] * global[2]);
+        if(problem->myRank() == 0)
+            cout << "Explicit rate check against one implicit step: cosine " << cosine << endl;
+        if(!converged and problem->myRank() == 0)
+            cerr << "Warning: the implicit step of the rate check has not converged, the sign of rhs() is not checked" << endl;
+        if(converged and cosine < 0.0) {
+            if(problem->myRank() == 0)
+                cerr << "The explicit rate points against the implicit step, the sign of rhs() does not match the kernels." << endl;
+            abort();
+        }
+    }
+
+    RunSummary summary(MPI_COMM_WORLD);
+    // Every count is written even when it stays 0, so that a baseline without rejections still catches them
+    summary.count("rate_evaluations", 0);
+    summary.count("rejected_steps", 0);
+    summary.count("steps", 0);
+    // M_lumped^{-1} F(y): residual-only assembly divided by the cached lumped mass, no linear solve
+    auto rate = [&](const vector<double>& y, vector<double>& dydt) {
+        summary.begin("rate");
+        setState(y);
+        problem->FillLinearSystem();
+        for(int i = 0; i < nPts; i++)
+            for(int f = 0; f < numDOFs; f++)
+                dydt[numDOFs*i+f] = problem->rhs()->getValue(f, i, IndexType::Local) / lumpedMass[numDOFs*i+f];
+        summary.end("rate");
+        summary.count("rate_evaluations");
+    };
+
+    // Weighted RMS norm of the local error estimate of a step Y0 -> Y1 (Sommeijer, Shampine & Verwer, 1997):
+    //     est = 0.8 (Y0 - Y1) + 0.4 tau (F(Y0) + F(Y1))
+    // with absolute and relative tolerance tol. The step is accepted when the norm is at most 1.
+    const double tol = paramStr->getRealParameter(Params::rkctol);
+    auto errorNorm = [&](const vector<double>& y0, const vector<double>& y1, const vector<double>& f0,
+                         const vector<double>& f1, double tau) {
+        double local[2]{0.0, static_cast<double>(size)};
+        for(int n = 0; n < size; n++) {
+            const double est = 0.8 * (y0[n] - y1[n]) + 0.4 * tau * (f0[n] + f1[n]);
+            const double w = tol + tol * std::max(std::abs(y0[n]), std::abs(y1[n]));
+            local[0] += (est / w) * (est / w);
+        }
+        double global[2];
+        MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        return std::sqrt(global[0] / global[1]);
+    };
+
+    PatternAnalysis analysis(fieldMorphogens, 0, PatternAnalysis::Geometry::PeriodicSquare,
+                             static_cast<int>(paramStr->getRealParameter(Params::analysisbins)), domainLength,
+                             paramStr->getStringParameter(Params::prefix) + "_pattern.txt");
+    const int analysisEvery = static_cast<int>(paramStr->getRealParameter(Params::analysisevery));
+    const int outputEvery = static_cast<int>(paramStr->getRealParameter(Params::outputevery));
+
+    vector<double> Y0(size), F0(size), Yjm1(size), Yjm2(size), Yj(size), Fj(size), F1(size);
+
+    double t{};
+    double dt = paramStr->getRealParameter(Params::dt);
+    if(problem->myRank() == 0)
+        cout << "RKC: spectral radius " << rho << ", error tolerance " << tol << endl;
+
+    // F(Y0) of an accepted step is F(Y1) of the previous one, so it is evaluated once here
+    getState(Y0);
+    rate(Y0, F0);
+
+    const int lastStep = paramStr->getRealParameter(Params::nsteps) > 0.0 ? static_cast<int>(paramStr->getRealParameter(Params::nsteps)) : 7999;
+    for(int i = 1; i <= lastStep; i++) {
+        // The stage count follows the step size, so it is recomputed whenever dt changes
+        const int s = RKCCoefficients::numStages(dt, rho);
+        const RKCCoefficients rkc(s);
+        if(problem->myRank() == 0)
+            std::cout << "step: " << i << " : t: " << t << " : dt: " << dt << " : stages: " << s << endl;
+
+        for(int n = 0; n < size; n++) {
+            Yjm2[n] = Y0[n];
+            Yjm1[n] = Y0[n] + rkc.muT[1] * dt * F0[n];
+        }
+        for(int j = 2; j <= s; j++) {
+            rate(Yjm1, Fj);
+            for(int n = 0; n < size; n++)
+                Yj[n] = (1.0 - rkc.mu[j] - rkc.nu[j]) * Y0[n] + rkc.mu[j] * Yjm1[n] + rkc.nu[j] * Yjm2[n]
+                        + rkc.muT[j] * dt * Fj[n] + rkc.gammaT[j] * dt * F0[n];
+            std::swap(Yjm2, Yjm1);
+            std::swap(Yjm1, Yj);
+        }
+        // Also leaves Yjm1 as the state of fieldMorphogens
+        rate(Yjm1, F1);
+
+        if(tol > 0.0) {
+            const double err = errorNorm(Y0, Yjm1, F0, F1, dt);
+            const double factor = std::clamp(0.8 * std::pow(std::max(err, 1.E-10), -1.0 / 3.0), 0.1, 10.0);
+            if(err > 1.0) {
+                if(problem->myRank() == 0)
+                    std::cout << "RKC: step rejected, error " << err << endl;
+                summary.count("rejected_steps");
+                setState(Y0);
+                dt *= factor;
+                if(dt < 1.E-10)
+                    break;
+                i--;
+                continue;
+            }
+            t += dt;
+            dt *= factor;
+        }
+        else
+            t += dt;
+        std::swap(Y0, Yjm1);
+        std::swap(F0, F1);
+        summary.count("steps");
+
+        if(outputEvery > 0 and i % outputEvery == 0) {
+            summary.begin("output");
+            std::string fileI = paramStr->getStringParameter(Params::prefix) + "_morphogens_" + to_string(i);
+            fieldMorphogens->printFileVtk(fileI, true);
+            summary.end("output");
+        }
+        if(analysisEvery > 0 and i % analysisEvery == 0) {
+            summary.begin("analysis");
+            analysis.analyze(i, t);
+            summary.end("analysis");
+        }
+    }
+
+    summary.value("time", t);
+    summary.value("mean_c", FieldMean(fieldMorphogens, 0));
+    summary.value("mean_h", FieldMean(fieldMorphogens, 1));
+    summary.write(paramStr->getStringParameter(Params::prefix) + "_summary.txt");
+
+    hiperlife::Finalize();
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "RunSummary.h"
+
+RunSummary::RunSummary(MPI_Comm comm)
+    : _comm(comm), _start(MPI_Wtime())
+{
+}
+
+void RunSummary::begin(const std::string& phase)
+{
+    _open[phase] = MPI_Wtime();
+}
+
+void RunSummary::end(const std::string& phase)
+{
+    const auto open = _open.find(phase);
+    if(open == _open.end()) {
+        std::cerr << "RunSummary: phase " << phase << " ended without having begun." << std::endl;
+        abort();
+    }
+    _times[phase] += MPI_Wtime() - open->second;
+    _open.erase(open);
+}
+
+void RunSummary::count(const std::string& name, long n)
+{
+    _counts[name] += n;
+}
+
+void RunSummary::value(const std::string& name, double v)
+{
+    _values[name] = v;
+}
+
+void RunSummary::write(const std::string& fileName) const
+{
+    // Every rank has seen the same phases, so the maps line up
+    std::vector<double> local{MPI_Wtime() - _start};
+    for(const auto& [phase, time] : _times)
+        local.push_back(time);
+    std::vector<double> times(local.size());
+    MPI_Reduce(local.data(), times.data(), static_cast<int>(local.size()), MPI_DOUBLE, MPI_MAX, 0, _comm);
+
+    int rank;
+    MPI_Comm_rank(_comm, &rank);
+    if(rank != 0)
+        return;
+
+    // Keys are single words
+    const auto key = [](std::string name) {
+        std::replace(name.begin(), name.end(), ' ', '_');
+        return name;
+    };
+
+    std::ofstream out(fileName);
+    out << std::setprecision(10);
+    out << "time.total " << times[0] << "\n";
+    int t = 1;
+    for(const auto& [phase, time] : _times)
+        out << "time." << key(phase) << " " << times[t++] << "\n";
+    for(const auto& [name, n] : _counts)
+        out << "count." << key(name) << " " << n << "\n";
+    for(const auto& [name, v] : _values)
+        out << "value." << key(name) << " " << v << "\n";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <mpi.h>
+
+// Summary of a run for performance regression checks: wall time per phase, event counts (Newton
+// iterations, rejected steps, ...) and final values (integrals of the fields). write() produces one
+// "key value" line per entry, with the keys prefixed by time., count. and value., which is the format
+// read by hlCompareSummary.
+class RunSummary
+{
+public:
+    explicit RunSummary(MPI_Comm comm);
+
+    // Accumulate the wall time between begin and end into a phase
+    void begin(const std::string& phase);
+    void end(const std::string& phase);
+
+    void count(const std::string& name, long n = 1);
+
+    void value(const std::string& name, double v);
+
+    // Phase times are the maximum over ranks; counts and values are expected to agree on all ranks
+    void write(const std::string& fileName) const;
+
+private:
+    MPI_Comm _comm;
+    double _start;
+    std::map<std::string, double> _times;
+    std::map<std::string, double> _open;
+    std::map<std::string, long> _counts;
+    std::map<std::string, double> _values;
+};
@@ -0,0 +1,111 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "Random.h"
+#include "SampledConsistencyCheck.h"
+
+SampledConsistency& SampledConsistency::instance()
+{
+    static SampledConsistency check;
+    return check;
+}
+
+void SampledConsistency::configure(const std::string& field, double rate, int every, double delta, double tolerance, uint32_t seed)
+{
+    _field = field;
+    _rate = rate;
+    _every = std::max(1, every);
+    _delta = delta;
+    _tolerance = tolerance;
+    _seed = seed;
+}
+
+void SampledConsistency::beginStep(int step)
+{
+    _step = step;
+    _active = _rate > 0.0 and step % _every == 0;
+}
+
+bool SampledConsistency::sample()
+{
+    if(!_active)
+        return false;
+
+    // The draw is keyed on the step and the fill counter, so a rerun with the same seed and partition checks
+    // the same fills
+    const uint64_t call = _calls.fetch_add(1, std::memory_order_relaxed);
+    const Philox4x32::Counter r = Philox4x32::generate(
+            {uint32_t(call), uint32_t(call >> 32), uint32_t(_step), 0u}, {_seed, 0x5A3Cu});
+    return r[0] * 0x1.0p-32 < _rate;
+}
+
+void SampledConsistency::record(const Entry& entry)
+{
+    _checked.fetch_add(1, std::memory_order_relaxed);
+    if(entry.error > _tolerance)
+        _failed.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(static_cast<int>(_worst.size()) < numWorst or entry.error > _worst.back().error) {
+        _worst.insert(std::upper_bound(_worst.begin(), _worst.end(), entry,
+                                       [](const Entry& a, const Entry& b) { return a.error > b.error; }), entry);
+        if(static_cast<int>(_worst.size()) > numWorst)
+            _worst.pop_back();
+    }
+}
+
+void SampledConsistency::report(MPI_Comm comm, const std::string& fileName)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    unsigned long long counts[2] = {_checked.load(), _failed.load()};
+    unsigned long long total[2];
+    MPI_Reduce(counts, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, comm);
+
+    // Every rank sends numWorst entries, padded with negative errors
+    constexpr int width = 6;
+    std::vector<double> local(numWorst * width, -1.0);
+    for(int e = 0; e < static_cast<int>(_worst.size()); e++) {
+        const Entry& entry = _worst[e];
+        double* row = &local[e * width];
+        row[0] = entry.error;
+        row[1] = entry.jacobian;
+        row[2] = entry.finiteDifference;
+        row[3] = entry.step;
+        row[4] = entry.row;
+        row[5] = entry.col;
+    }
+    std::vector<double> all(rank == 0 ? size * numWorst * width : 0);
+    MPI_Gather(local.data(), numWorst * width, MPI_DOUBLE, all.data(), numWorst * width, MPI_DOUBLE, 0, comm);
+
+    if(rank != 0)
+        return;
+
+    std::vector<std::pair<Entry, int>> worst;
+    for(int p = 0; p < size; p++)
+        for(int e = 0; e < numWorst; e++) {
+            const double* row = &all[(p * numWorst + e) * width];
+            if(row[0] >= 0.0)
+                worst.push_back({{row[0], row[1], row[2], int(row[3]), int(row[4]), int(row[5])}, p});
+        }
+    std::sort(worst.begin(), worst.end(), [](const auto& a, const auto& b) { return a.first.error > b.first.error; });
+    if(static_cast<int>(worst.size()) > numWorst)
+        worst.resize(numWorst);
+
+    std::ofstream out(fileName);
+    for(std::ostream* stream : {static_cast<std::ostream*>(&std::cout), static_cast<std::ostream*>(&out)}) {
+        *stream << "Sampled consistency check of " << _field << ": " << total[0] << " fills checked, "
+                << total[1] << " above tolerance " << _tolerance << std::endl;
+        if(worst.empty())
+            continue;
+        *stream << "  error  Ak  finite difference  step  row  col  rank" << std::endl;
+        *stream << std::scientific << std::setprecision(4);
+        for(const auto& [entry, p] : worst)
+            *stream << "  " << entry.error << "  " << entry.jacobian << "  " << entry.finiteDifference << "  "
+                    << entry.step << "  " << entry.row << "  " << entry.col << "  " << p << std::endl;
+        *stream << std::defaultfloat;
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <hl_HiPerProblem.h>
+
+// Sampled Jacobian check for production runs. ConsistencyCheck<F> finite-differences every element fill of
+// every assembly; SampledConsistencyCheck<F> does it only for a random fraction of the fills of every N-th
+// time step, so the cost is bounded by rate * (2 * eNN * numDOFs + 1) fills on the checked steps. The worst
+// mismatches between the assembled Jacobian and the central differences of the residual are kept and
+// reported at the end of the run.
+class SampledConsistency
+{
+public:
+    struct Entry
+    {
+        double error;                                // |Ak - FD| relative to the size of the element Jacobian
+        double jacobian;
+        double finiteDifference;
+        int step;
+        int row;                                     // I * numDOFs + f
+        int col;                                     // J * numDOFs + g
+    };
+
+    static SampledConsistency& instance();
+
+    // rate: fraction of the fills checked, every: time steps between checked steps, field: name tag of the
+    // DOFsHandler whose Jacobian block (0, 0) is checked
+    void configure(const std::string& field, double rate, int every, double delta, double tolerance, uint32_t seed);
+
+    // Called by the driver at the start of every time step
+    void beginStep(int step);
+
+    bool sample();
+
+    // Records the worst entry of a checked fill
+    void record(const Entry& entry);
+
+    const std::string& field() const { return _field; }
+    double delta() const { return _delta; }
+    int step() const { return _step; }
+
+    // Reduces the worst entries over the ranks and writes them from rank 0
+    void report(MPI_Comm comm, const std::string& fileName);
+
+    static constexpr int numWorst = 10;
+
+private:
+    std::string _field;
+    double _rate{};
+    int _every{1};
+    double _delta{1.E-6};
+    double _tolerance{1.E-4};
+    uint32_t _seed{};
+
+    int _step{};
+    bool _active{};
+    std::atomic<uint64_t> _calls{};
+    std::atomic<uint64_t> _checked{};
+    std::atomic<uint64_t> _failed{};
+
+    std::mutex _mutex;
+    std::vector<Entry> _worst;
+};
+
+template<void (*F)(hiperlife::FillStructure&)>
+void SampledConsistencyCheck(hiperlife::FillStructure& fillStr)
+{
+    using namespace hiperlife;
+
+    F(fillStr);
+
+    SampledConsistency& check = SampledConsistency::instance();
+    if(!check.sample())
+        return;
+
+    SubFillStructure& subFill = fillStr[check.field()];
+    const int n = subFill.eNN * subFill.numDOFs;
+
+    double* Ak = fillStr.Ak(0, 0).data();
+    double* Bk = fillStr.Bk(0).data();
+    const std::vector<double> jacobian(Ak, Ak + n * n);
+    const std::vector<double> residual(Bk, Bk + n);
+
+    double scale{};
+    for(double a : jacobian)
+        scale = std::max(scale, std::abs(a));
+    scale = std::max(scale, 1.E-12);
+
+    SampledConsistency::Entry worst{-1.0};
+    std::vector<double> plus(n);
+    for(int col = 0; col < n; col++) {
+        double& u = subFill.nborDOFs[col];
+        const double u0 = u;
+        const double h = check.delta() * std::max(1.0, std::abs(u0));
+
+        u = u0 + h;
+        F(fillStr);
+        std::copy(Bk, Bk + n, plus.begin());
+        u = u0 - h;
+        F(fillStr);
+        u = u0;
+
+        for(int row = 0; row < n; row++) {
+            const double fd = (plus[row] - Bk[row]) / (2.0 * h);
+            const double a = jacobian[row * n + col];
+            const double error = std::abs(a - fd) / scale;
+            if(error > worst.error)
+                worst = {error, a, fd, check.step(), row, col};
+        }
+    }
+    check.record(worst);
+
+    std::copy(jacobian.begin(), jacobian.end(), Ak);
+    std::copy(residual.begin(), residual.end(), Bk);
+}
@@ -0,0 +1,91 @@
+#!/bin/bash
+# Fixed-seed performance regression suite. Runs every case, writes <case>_summary.txt in the work directory
+# and compares it with hlCompareSummary against two baselines:
+#   - benchmarks/baselines/<case>_summary.txt holds the counts and final values. They do not depend on the
+#     machine, so this file is committed; a case without it fails unless --update is given.
+#   - <timings>/<case>_summary.txt holds the phase times of this machine. It stays out of the repository and
+#     is compared only when present.
+# --update stores both from the current run.
+#
+#     benchmarks/run_benchmarks.sh [--update] [--bin DIR] [--np N] [--work DIR] [--timings DIR] [-- compare options]
+#
+# Environment: MPIRUN (default mpirun).
+
+set -u
+
+here="$(cd "$(dirname "$0")" && pwd)"
+baselines="$here/baselines"
+bin="$here/../build"
+work="$PWD/benchmarks_run"
+timings=""
+np=1
+update=0
+compareOptions=()
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --update) update=1 ;;
+        --bin) bin="$2"; shift ;;
+        --np) np="$2"; shift ;;
+        --work) work="$2"; shift ;;
+        --timings) timings="$2"; shift ;;
+        --) shift; compareOptions=("$@"); break ;;
+        *) echo "unknown option $1" >&2; exit 2 ;;
+    esac
+    shift
+done
+
+timings="${timings:-$work/timings}"
+mkdir -p "$work" "$baselines" "$timings"
+
+# Turns name=value pairs into the command line read by ReadParamsFromCommandLine; the only place that
+# depends on its syntax.
+params() {
+    for pair in "$@"; do
+        printf -- '-%s %s ' "${pair%%=*}" "${pair#*=}"
+    done
+}
+
+# Output and analysis are switched off so the timings measure the solvers only
+common=(seed=1 outputevery=0 analysisevery=0)
+
+failed=0
+run_case() {
+    local name="$1" executable="$2"
+    shift 2
+
+    echo "== $name"
+    # shellcheck disable=SC2046
+    if ! (cd "$work" && ${MPIRUN:-mpirun} -np "$np" "$bin/$executable" $(params "${common[@]}" prefix="$name" "$@") > "$name.log" 2>&1); then
+        echo "FAIL  $name did not run, see $work/$name.log"
+        failed=1
+        return
+    fi
+
+    local summary="$work/${name}_summary.txt"
+    if [ "$update" -eq 1 ]; then
+        grep -E '^(count|value)\.' "$summary" > "$baselines/${name}_summary.txt"
+        grep -E '^time\.' "$summary" > "$timings/${name}_summary.txt"
+        echo "baselines stored"
+        return
+    fi
+
+    if [ -f "$baselines/${name}_summary.txt" ]; then
+        "$bin/hlCompareSummary" "$baselines/${name}_summary.txt" "$summary" "${compareOptions[@]}" || failed=1
+    else
+        echo "FAIL  $name has no baseline, run with --update to store one"
+        failed=1
+    fi
+    if [ -f "$timings/${name}_summary.txt" ]; then
+        "$bin/hlCompareSummary" "$timings/${name}_summary.txt" "$summary" "${compareOptions[@]}" || failed=1
+    fi
+}
+
+run_case periodic_coarse hlConvectionDiffusion nelem=250 nsteps=200
+run_case periodic_fine hlConvectionDiffusion nelem=1000 nsteps=200
+run_case ale_coarse hlConvectionDiffusionALE meshsize=0.004 nsteps=50
+run_case ale_fine hlConvectionDiffusionALE meshsize=0.002 nsteps=50
+run_case grayscott_coarse hlReactionDiffusionRKC model=grayscott nelem=100 nsteps=500
+run_case grayscott_fine hlReactionDiffusionRKC model=grayscott nelem=200 nsteps=500
+
+exit $failed